@@ -0,0 +1,101 @@
+/******************************************************************************
+
+lhc.h: the C interface of the Latin hypercube generator.
+
+For programs in C, Fortran (bind(c)), Julia (ccall), Python (ctypes) and
+anything else that can call C. A generator is created from the same
+arguments as the lhc command line, without the output options, and then
+writes any range of its rows straight into memory owned by the caller:
+
+    const char* args[] = {"-n", "1000", "-d", "4", "--seed", "7", "-s", "1:normal:0:1"};
+    lhc_generator* generator;
+    if (lhc_create(&generator, 8, args) != LHC_OK) {
+        fprintf(stderr, "%s\n", lhc_last_error());
+    }
+    double* points = malloc(1000 * 4 * sizeof(double));
+    lhc_generate_into(generator, points, 4, 0, 1000, LHC_ROW_MAJOR);
+    lhc_destroy(generator);
+
+The values are those that lhc writes for the same arguments, before they are
+rounded to text. Integer dimensions hold the integers, categorical dimensions
+the index of their label.
+
+lhc_create() generates the strata, which is where the time of optimised
+designs (--candidates, --method oa) goes; lhc_generate_into() only computes
+values into the buffer, on all cores for large ranges, and allocates no
+buffers of its own. It only reads the generator, so several threads may fill
+different ranges of the same generator at once.
+
+Functions return LHC_OK or an error code and never throw or abort. The message
+of the last error on the calling thread is available from lhc_last_error().
+
+Build the library with
+
+    g++ -shared -fPIC -fvisibility=hidden -O2 -I include -o liblhc.so src/lhc_capi.cpp -pthread
+
+*******************************************************************************/
+
+#ifndef LHC_H
+#define LHC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(_WIN32)
+#define LHC_API __declspec(dllexport)
+#else
+#define LHC_API __attribute__((visibility("default")))
+#endif
+
+/* Changes whenever a function or its meaning changes incompatibly. */
+#define LHC_ABI_VERSION 1
+
+/* Return codes. */
+#define LHC_OK 0
+#define LHC_ERROR_INVALID_ARGUMENT 1 /* bad options or parameters; see lhc_last_error() */
+#define LHC_ERROR_OUT_OF_RANGE 2     /* rows outside the design, or a leading dimension too small */
+#define LHC_ERROR_OUT_OF_MEMORY 3
+#define LHC_ERROR_IO 4               /* a system call failed */
+#define LHC_ERROR_INTERNAL 5
+
+/* Layouts for lhc_generate_into(). */
+#define LHC_ROW_MAJOR 0    /* value (row, dimension) at buffer[row * ld + dimension], ld >= dimensions */
+#define LHC_COLUMN_MAJOR 1 /* value (row, dimension) at buffer[dimension * ld + row], ld >= rows (Fortran, Julia) */
+
+typedef struct lhc_generator lhc_generator;
+
+/* LHC_ABI_VERSION of the library, to check against the header at run time. */
+LHC_API int lhc_abi_version(void);
+
+/* Creates a generator from lhc arguments such as {"-n", "1000", "-d", "4"}, without the
+   program name. Output options (--out-path, --compress, --format, --slices, --out-shards,
+   --dry-run) are rejected. On success *generator must be released with lhc_destroy(). */
+LHC_API int lhc_create(lhc_generator** generator, int argc, const char* const* argv);
+
+/* As lhc_create(), from one string of arguments separated by spaces; quotes group words. */
+LHC_API int lhc_create_from_string(lhc_generator** generator, const char* arguments);
+
+/* The number of points and of dimensions of the design, or -1 for a null generator. */
+LHC_API int64_t lhc_rows(const lhc_generator* generator);
+LHC_API int lhc_dimensions(const lhc_generator* generator);
+
+/* Writes rows [first_row, first_row + rows) of the design into buffer, in the given
+   layout with leading dimension ld; row indices within the buffer start at 0. */
+LHC_API int lhc_generate_into(const lhc_generator* generator, double* buffer, size_t ld, int64_t first_row, int64_t rows, int layout);
+
+/* Releases a generator; null is ignored. */
+LHC_API void lhc_destroy(lhc_generator* generator);
+
+/* The message of the last failed call on this thread, or "" if there was none. Valid until
+   the next failure on this thread. */
+LHC_API const char* lhc_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
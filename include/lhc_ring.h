@@ -0,0 +1,238 @@
+/******************************************************************************
+
+lhc_ring.h: reading a design that lhc publishes to a shared-memory ring.
+
+    lhc -n 100000000 -d 8 --format binary -o shm:/lhc-ring
+
+creates the POSIX shared-memory segment /lhc-ring and writes the design into
+it block by block. The segment holds a header and a fixed number of slots of
+equal size. lhc fills the slots in turn and waits whenever all of them hold
+blocks that the consumer has not released yet, so a consumer can start on the
+first block while the rest of the design is still being generated, and memory
+stays bounded however large the design is.
+
+A consumer includes this header (C or C++, no library needed; in C, define
+_POSIX_C_SOURCE 200809L or _GNU_SOURCE for the POSIX calls):
+
+    lhc_ring ring;
+    const void* data;
+    size_t length;
+    uint32_t flags;
+    int status;
+    if (lhc_ring_open(&ring, "/lhc-ring", 10000) != 0) { ... }
+    while ((status = lhc_ring_acquire(&ring, &data, &length, &flags)) == 1) {
+        consume(data, length);          // whole rows, read in place
+        lhc_ring_release(&ring);
+    }
+    lhc_ring_close(&ring);              // status 0: complete, -1: lhc failed
+
+Blocks are whole CSV lines, or whole rows of ring.header->dimensions native
+doubles for --format binary. Compressed output is cut wherever a slot is full;
+LHC_RING_SLOT_CONTINUED then marks a block that goes on in the next slot. Slots
+hold at least two rows; a CSV line that is longer than lhc estimated, and fills
+a slot on its own, is cut and marked the same way.
+
+Indices are counters that only grow: head counts the slots published by lhc and
+tail those released by the consumer. Each is written by one side only, with
+release ordering, and read by the other with acquire ordering, so no locks are
+needed. There must be a single consumer. lhc_ring_open() records the consumer's
+process id and removes the name once the segment is mapped; the memory is freed
+when both sides have unmapped it.
+
+Each side notices that the other has died by its process id. A consumer whose
+lhc exits without finishing gets EPIPE; lhc fails if its consumer exits with
+the ring full, or if no consumer has opened the ring within a minute of it
+filling up.
+
+Link with -lrt on glibc older than 2.17.
+
+*******************************************************************************/
+
+#ifndef LHC_RING_H
+#define LHC_RING_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LHC_RING_MAGIC 0x31474e4952434c48ULL /* "LHCRING1" in little-endian order */
+#define LHC_RING_VERSION 1u
+
+/* lhc_ring_header.state */
+#define LHC_RING_WRITING 0u
+#define LHC_RING_FINISHED 1u
+#define LHC_RING_FAILED 2u
+
+/* lhc_ring_header.format */
+#define LHC_RING_CSV 0u
+#define LHC_RING_BINARY 1u
+
+/* lhc_ring_slot.flags */
+#define LHC_RING_SLOT_CONTINUED 1u
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* At the start of the segment. The indices and the state each have a cache line
+   of their own, so the two sides do not invalidate each other's lines needlessly. */
+struct lhc_ring_header {
+    uint64_t magic;          /* written last by lhc, once everything else is set */
+    uint32_t version;
+    uint32_t slot_count;
+    uint64_t slot_size;      /* bytes per slot, including its lhc_ring_slot */
+    uint64_t segment_size;
+    uint32_t format;         /* LHC_RING_CSV or LHC_RING_BINARY */
+    uint32_t compressed;     /* non-zero for gzip or zstd output */
+    uint64_t dimensions;
+    uint64_t rows;           /* rows in the whole design */
+    uint32_t producer_pid;   /* the lhc process, to notice that it died */
+    uint32_t consumer_pid;   /* the consumer, set by lhc_ring_open(), for lhc to notice the same */
+
+    uint64_t head;           /* slots published, written by lhc */
+    char head_padding[56];
+    uint64_t tail;           /* slots released, written by the consumer */
+    char tail_padding[56];
+    uint32_t state;          /* LHC_RING_WRITING, _FINISHED or _FAILED, written by lhc */
+    uint32_t reader_closed;  /* set by the consumer to stop lhc */
+    char state_padding[56];
+};
+
+/* At the start of every slot; the block follows it. */
+struct lhc_ring_slot {
+    uint64_t length;
+    uint32_t flags;
+    uint32_t reserved[13];
+};
+
+typedef struct lhc_ring {
+    struct lhc_ring_header* header;
+    size_t size;
+} lhc_ring;
+
+static inline struct lhc_ring_slot* lhc_ring_slot_at(const lhc_ring* ring, const uint64_t index) {
+    return (struct lhc_ring_slot*)((char*)ring->header + sizeof(struct lhc_ring_header)
+        + (index % ring->header->slot_count) * ring->header->slot_size);
+}
+
+/* Spins, then yields, then sleeps for 20 us at a time. */
+static inline void lhc_ring_pause(unsigned* spins) {
+    if (++*spins < 64) {
+        return;
+    }
+    if (*spins < 256) {
+        sched_yield();
+        return;
+    }
+    struct timespec delay = {0, 20000};
+    nanosleep(&delay, NULL);
+}
+
+/* Maps the ring called name (such as "/lhc-ring"), waiting up to timeout_ms for lhc to
+   create it, or forever if timeout_ms is negative, and removes the name. Returns 0, or -1
+   with errno set (ETIMEDOUT if the ring did not appear in time, EPROTO if it is not an
+   lhc ring of this version). Records the calling process as the consumer. */
+static inline int lhc_ring_open(lhc_ring* ring, const char* name, const int timeout_ms) {
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ring->header = NULL;
+    ring->size = 0;
+    for (;;) {
+        int descriptor = shm_open(name, O_RDWR, 0);
+        if (descriptor >= 0) {
+            struct stat status;
+            if (fstat(descriptor, &status) == 0 && (size_t)status.st_size >= sizeof(struct lhc_ring_header)) {
+                void* address = mmap(NULL, status.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+                close(descriptor);
+                if (address == MAP_FAILED) {
+                    return -1;
+                }
+                struct lhc_ring_header* header = (struct lhc_ring_header*)address;
+                if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) == LHC_RING_MAGIC) {
+                    if (header->version != LHC_RING_VERSION || header->segment_size > (uint64_t)status.st_size) {
+                        munmap(address, status.st_size);
+                        errno = EPROTO;
+                        return -1;
+                    }
+                    ring->header = header;
+                    ring->size = status.st_size;
+                    __atomic_store_n(&header->consumer_pid, (uint32_t)getpid(), __ATOMIC_RELEASE);
+                    shm_unlink(name);
+                    return 0;
+                }
+                munmap(address, status.st_size); /* lhc is still setting it up */
+            } else {
+                close(descriptor);
+            }
+        } else if (errno != ENOENT && errno != EACCES) {
+            return -1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (timeout_ms >= 0 && (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000 >= timeout_ms) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        struct timespec delay = {0, 1000000};
+        nanosleep(&delay, NULL);
+    }
+}
+
+/* Waits for the next block and points data at it in the segment. Returns 1 with a block,
+   which stays valid until lhc_ring_release(); 0 once the whole design has been read; -1
+   if lhc stopped with an error (errno EIO) or exited without finishing (errno EPIPE). */
+static inline int lhc_ring_acquire(lhc_ring* ring, const void** data, size_t* length, uint32_t* flags) {
+    struct lhc_ring_header* header = ring->header;
+    const uint64_t tail = header->tail;
+    unsigned spins = 0;
+    while (__atomic_load_n(&header->head, __ATOMIC_ACQUIRE) == tail) {
+        const uint32_t state = __atomic_load_n(&header->state, __ATOMIC_ACQUIRE);
+        if (state != LHC_RING_WRITING && __atomic_load_n(&header->head, __ATOMIC_ACQUIRE) == tail) {
+            if (state == LHC_RING_FAILED) {
+                errno = EIO;
+                return -1;
+            }
+            return 0;
+        }
+        /* checked every 256 pauses once the consumer sleeps, every few milliseconds */
+        if (spins >= 256 && spins % 256 == 0 && kill((pid_t)header->producer_pid, 0) != 0 && errno == ESRCH
+            && __atomic_load_n(&header->head, __ATOMIC_ACQUIRE) == tail && __atomic_load_n(&header->state, __ATOMIC_ACQUIRE) == LHC_RING_WRITING) {
+            errno = EPIPE;
+            return -1;
+        }
+        lhc_ring_pause(&spins);
+    }
+    const struct lhc_ring_slot* slot = lhc_ring_slot_at(ring, tail);
+    *data = slot + 1;
+    *length = slot->length;
+    if (flags != NULL) {
+        *flags = slot->flags;
+    }
+    return 1;
+}
+
+/* Hands the slot of the last acquired block back to lhc. */
+static inline void lhc_ring_release(lhc_ring* ring) {
+    __atomic_store_n(&ring->header->tail, ring->header->tail + 1, __ATOMIC_RELEASE);
+}
+
+/* Unmaps the ring. If lhc is still writing, it stops with an error. */
+static inline void lhc_ring_close(lhc_ring* ring) {
+    if (ring->header != NULL) {
+        __atomic_store_n(&ring->header->reader_closed, 1u, __ATOMIC_RELEASE);
+        munmap(ring->header, ring->size);
+        ring->header = NULL;
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
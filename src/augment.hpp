@@ -0,0 +1,68 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "progress.hpp"
+
+// Lists the strata in [0, strataCount) that none of the values fall into. Occupancy is kept
+// in a bitset and the free strata are read back a word at a time, so the cost is O(N).
+inline std::vector<long> emptyStrata(const std::vector<double>& values, const double lowerBound, const double ratio, const long strataCount) {
+    std::vector<uint64_t> occupied((strataCount + 63) / 64, 0);
+    for (const double value : values) {
+        // values written on a coarser grid may sit exactly on a boundary; nudge them past rounding error
+        double position = std::floor((value - lowerBound) / ratio + 1e-6);
+        if (position >= 0 && position < strataCount) {
+            long stratum = (long)position;
+            occupied[stratum >> 6] |= uint64_t(1) << (stratum & 63);
+        }
+    }
+
+    std::vector<long> empty;
+    for (long word = 0; word < (long)occupied.size(); word++) {
+        uint64_t free = ~occupied[word];
+        if (word == (long)occupied.size() - 1 && strataCount % 64 != 0) {
+            free &= (uint64_t(1) << (strataCount % 64)) - 1;
+        }
+        while (free) {
+            empty.push_back(word * 64 + __builtin_ctzll(free));
+            free &= free - 1;
+        }
+    }
+    return empty;
+}
+
+// Chooses strata for `additional` new points so that, together with the existing points, each
+// dimension is as close to Latin as possible on the finer (existing + additional)-level grid.
+// Returns one column per dimension; entry i is the stratum of new point i. Each finished
+// column advances progress, if given, by its values.
+inline std::vector<std::vector<long>> augmentStrata(
+    const std::vector<std::vector<double>>& existing,
+    const std::vector<std::array<double, 2>>& dimensionScales,
+    const long additional,
+    std::mt19937& generator,
+    Progress* progress = nullptr
+) {
+    const long strataCount = (existing.empty() ? 0 : existing[0].size()) + additional;
+    std::vector<std::vector<long>> strata(existing.size());
+    for (size_t dimensionIndex = 0; dimensionIndex < existing.size(); dimensionIndex++) {
+        const double lowerBound = dimensionScales[dimensionIndex][0];
+        const double ratio = (dimensionScales[dimensionIndex][1] - lowerBound) / strataCount;
+        std::vector<long> empty = emptyStrata(existing[dimensionIndex], lowerBound, ratio, strataCount);
+
+        // there are at least `additional` free strata; pick a random subset in random order
+        for (long i = 0; i < additional; i++) {
+            std::uniform_int_distribution<long> pick(i, (long)empty.size() - 1);
+            std::swap(empty[i], empty[pick(generator)]);
+        }
+        empty.resize(additional);
+        strata[dimensionIndex] = std::move(empty);
+        if (progress != nullptr) {
+            progress->advance(additional);
+        }
+    }
+    return strata;
+}
@@ -0,0 +1,222 @@
+/******************************************************************************
+
+Design cache.
+
+Optimised designs (--candidates, --method oa) can take minutes to build, and
+pipelines often ask for the same one again. With --cache-dir, the strata of a
+design and the seed of its random variance are stored in a file named after a
+hash of everything they depend on, and a later run with the same spec maps
+that file instead of building them. Bounds, distributions, headings and the
+output options only change how the strata become values and text, so they
+are not part of the key and runs that differ only in those share an entry.
+
+An entry is written to a temporary file and renamed into place, so readers,
+including other processes, see either a whole entry or none. The spec is
+stored in the entry and compared on reading, so a hash collision is a miss and
+not a wrong design. Reading refreshes the entry's modification time, and after
+every write the oldest entries are removed until the directory is within
+--cache-size again.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "design.hpp"
+#include "mapped_file.hpp"
+#include "output.hpp"
+#include "parallel.hpp"
+
+const std::string CACHE_EXTENSION = ".lhcd";
+constexpr char CACHE_MAGIC[8] = {'L', 'H', 'C', 'D', 'E', 'S', 'N', '1'};
+
+// At the start of an entry; the spec follows, padded to 8 bytes, then one column of
+// 64-bit stratum indices per dimension.
+struct CacheHeader {
+    char magic[8];
+    uint64_t specBytes;
+    uint64_t rows;
+    uint64_t dimensions;
+    uint64_t jitterSeed;
+};
+
+// 64-bit FNV-1a, continued from hash.
+inline uint64_t fnv1a(const char* data, const size_t length, uint64_t hash = 0xcbf29ce484222325ULL) {
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)data[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+class DesignCache {
+public:
+    // Creates the directory if it does not exist yet. Throws if that fails.
+    DesignCache(const std::string& directory, const uint64_t maxBytes) : directory(directory), maxBytes(maxBytes) {
+        if (::mkdir(directory.c_str(), 0777) != 0 && errno != EEXIST) {
+            throw std::runtime_error("Cannot create cache directory " + directory + ": " + std::strerror(errno));
+        }
+        struct stat status;
+        if (::stat(directory.c_str(), &status) != 0 || !S_ISDIR(status.st_mode)) {
+            throw std::runtime_error("Cache directory is not a directory: " + directory);
+        }
+    }
+
+    std::string path(const std::string& spec) const {
+        char name[17];
+        std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)fnv1a(spec.data(), spec.size()));
+        return directory + "/" + name + CACHE_EXTENSION;
+    }
+
+    // Fills the strata and jitter seed of design from the entry for spec. Returns false if
+    // there is no complete entry for exactly this spec.
+    bool load(const std::string& spec, Design& design, ThreadPool& pool) const {
+        const std::string entryPath = path(spec);
+        if (::access(entryPath.c_str(), R_OK) != 0) {
+            return false;
+        }
+        MappedFile entry(entryPath);
+        CacheHeader header;
+        if (entry.size() < sizeof(header)) {
+            return false;
+        }
+        std::memcpy(&header, entry.data(), sizeof(header));
+        const uint64_t strataOffset = dataOffset(header.specBytes);
+        if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0
+            || header.specBytes != spec.size()
+            || header.dimensions != (uint64_t)design.dimensions()
+            || entry.size() != strataOffset + header.rows * header.dimensions * sizeof(int64_t)
+            || spec.compare(0, spec.size(), entry.data() + sizeof(header), header.specBytes) != 0) {
+            return false;
+        }
+
+        design.strata = allocateStrata(design, header.rows, pool);
+        pool.forEach(header.dimensions, [&](const long dimension) {
+            std::memcpy(design.strata[dimension].data(), entry.data() + strataOffset + dimension * header.rows * sizeof(int64_t), header.rows * sizeof(int64_t));
+        });
+        design.jitterSeed = header.jitterSeed;
+        ::utimensat(AT_FDCWD, entryPath.c_str(), nullptr, 0); // most recently used
+        return true;
+    }
+
+    // Stores the strata and jitter seed of design under spec, then evicts the least recently
+    // used entries beyond the size limit. An entry larger than the limit is not stored.
+    // Returns whether the entry was stored; throws if writing it fails.
+    bool store(const std::string& spec, const Design& design) {
+        const uint64_t rows = design.rows();
+        const uint64_t strataOffset = dataOffset(spec.size());
+        if (strataOffset + rows * design.dimensions() * sizeof(int64_t) > maxBytes) {
+            return false;
+        }
+
+        static std::atomic<unsigned> counter{0};
+        const std::string entryPath = path(spec);
+        const std::string temporaryPath = entryPath + ".tmp." + std::to_string(::getpid()) + "." + std::to_string(counter++);
+        const int descriptor = ::open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+        if (descriptor < 0) {
+            throw std::runtime_error("Failed to create cache entry " + temporaryPath + ": " + std::strerror(errno));
+        }
+        try {
+            CacheHeader header{};
+            std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+            header.specBytes = spec.size();
+            header.rows = rows;
+            header.dimensions = design.dimensions();
+            header.jitterSeed = design.jitterSeed;
+            std::string prefix(reinterpret_cast<const char*>(&header), sizeof(header));
+            prefix += spec;
+            prefix.resize(strataOffset, '\0');
+            writeAll(descriptor, prefix.data(), prefix.size(), temporaryPath);
+            for (const std::vector<long>& column : design.strata) {
+                static_assert(sizeof(long) == sizeof(int64_t), "strata are stored as 64-bit integers");
+                writeAll(descriptor, reinterpret_cast<const char*>(column.data()), column.size() * sizeof(long), temporaryPath);
+            }
+            if (::fdatasync(descriptor) != 0) {
+                throw std::runtime_error("Failed to write cache entry " + temporaryPath + ": " + std::strerror(errno));
+            }
+        } catch (...) {
+            ::close(descriptor);
+            ::unlink(temporaryPath.c_str());
+            throw;
+        }
+        ::close(descriptor);
+        if (::rename(temporaryPath.c_str(), entryPath.c_str()) != 0) {
+            const int error = errno;
+            ::unlink(temporaryPath.c_str());
+            throw std::runtime_error("Failed to store cache entry " + entryPath + ": " + std::strerror(error));
+        }
+        evict(entryPath);
+        return true;
+    }
+
+private:
+    static uint64_t dataOffset(const uint64_t specBytes) {
+        return (sizeof(CacheHeader) + specBytes + 7) / 8 * 8;
+    }
+
+    static void writeAll(const int descriptor, const char* data, size_t length, const std::string& path) {
+        while (length > 0) {
+            const ssize_t written = ::write(descriptor, data, length);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error("Failed to write cache entry " + path + ": " + std::strerror(errno));
+            }
+            data += written;
+            length -= written;
+        }
+    }
+
+    // Removes the least recently used entries, other than keep, until the entries fit in
+    // maxBytes. Entries that disappear meanwhile, removed by another process, are skipped.
+    void evict(const std::string& keep) const {
+        struct Entry {
+            std::string path;
+            uint64_t bytes;
+            struct timespec used;
+        };
+        std::vector<Entry> entries;
+        uint64_t total = 0;
+        DIR* listing = ::opendir(directory.c_str());
+        if (listing == nullptr) {
+            return;
+        }
+        while (const dirent* item = ::readdir(listing)) {
+            const std::string name = item->d_name;
+            struct stat status;
+            const std::string entryPath = directory + "/" + name;
+            if (endsWith(name, CACHE_EXTENSION) && ::stat(entryPath.c_str(), &status) == 0) {
+                entries.push_back({entryPath, (uint64_t)status.st_size, status.st_mtim});
+                total += status.st_size;
+            }
+        }
+        ::closedir(listing);
+
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+            return a.used.tv_sec != b.used.tv_sec ? a.used.tv_sec < b.used.tv_sec : a.used.tv_nsec < b.used.tv_nsec;
+        });
+        for (const Entry& entry : entries) {
+            if (total <= maxBytes) {
+                break;
+            }
+            if (entry.path != keep && (::unlink(entry.path.c_str()) == 0 || errno == ENOENT)) {
+                total -= entry.bytes;
+            }
+        }
+    }
+
+    const std::string directory;
+    const uint64_t maxBytes;
+};
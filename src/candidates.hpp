@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <vector>
+#include "parallel.hpp"
+#include "progress.hpp"
+#include "shuffle.hpp"
+
+// Fills each dimension with an independent random permutation of the strata. Every dimension
+// is shuffled as its own task, with a seed drawn from the given generator, and large columns
+// are shuffled in parallel themselves, so the result does not depend on the number of threads.
+// Columns already allocated in strata, such as ones placed by allocateStrata(), are reused.
+// Each finished column advances progress, if given, by its values.
+inline std::vector<std::vector<long>> randomStrata(const long numberOfPoints, const int numberOfDimensions, std::mt19937& generator, ThreadPool& pool, std::vector<std::vector<long>> strata = {}, Progress* progress = nullptr) {
+    std::vector<unsigned int> seeds(numberOfDimensions);
+    for (unsigned int& dimensionSeed : seeds) {
+        dimensionSeed = generator();
+    }
+    strata.resize(numberOfDimensions);
+    pool.forEach(numberOfDimensions, [&](const long dimensionIndex) {
+        randomPermutation(strata[dimensionIndex], numberOfPoints, seeds[dimensionIndex], pool);
+        if (progress != nullptr) {
+            progress->advance(numberOfPoints);
+        }
+    });
+    return strata;
+}
+
+// The implicit counterpart of randomStrata(): one random-access permutation per dimension,
+// each keyed with a seed drawn from the given generator.
+inline std::vector<RandomAccessPermutation> randomPermutations(const long numberOfPoints, const int numberOfDimensions, std::mt19937& generator) {
+    std::vector<RandomAccessPermutation> permutations;
+    for (int dimensionIndex = 0; dimensionIndex < numberOfDimensions; dimensionIndex++) {
+        permutations.emplace_back(numberOfPoints, generator());
+    }
+    return permutations;
+}
+
+// Rows per tile of the correlation metric.
+constexpr long CORRELATION_BLOCK_ROWS = 1 << 16;
+
+// Largest absolute correlation between any two columns of a design; lower is better.
+// Every column is a permutation of 0..N-1, so all columns share the same mean and
+// variance and only the cross products need to be accumulated: O(N * D^2). They are summed
+// in (dimension, row-block) tiles on the pool and the partial sums are added in block
+// order, so the score does not depend on the number of threads.
+inline double maxAbsCorrelation(const std::vector<std::vector<long>>& strata, ThreadPool& pool) {
+    if (strata.size() < 2 || strata[0].size() < 2) {
+        return 0;
+    }
+    const long dimensions = strata.size();
+    const long rows = strata[0].size();
+    const long blocks = (rows + CORRELATION_BLOCK_ROWS - 1) / CORRELATION_BLOCK_ROWS;
+    const double n = rows;
+    const double mean = (n - 1) / 2;
+    const double variance = (n * n - 1) / 12;
+
+    // partial[(block * dimensions + first) * dimensions + second] for first < second
+    std::vector<double> partial(blocks * dimensions * dimensions);
+    pool.forEach(blocks * (dimensions - 1), [&](const long tile) {
+        const long block = tile / (dimensions - 1);
+        const long first = tile % (dimensions - 1);
+        const long firstRow = block * CORRELATION_BLOCK_ROWS;
+        const long lastRow = std::min(rows, firstRow + CORRELATION_BLOCK_ROWS);
+        const long* a = strata[first].data();
+        for (long second = first + 1; second < dimensions; second++) {
+            const long* b = strata[second].data();
+            double crossProducts = 0;
+            for (long row = firstRow; row < lastRow; row++) {
+                crossProducts += (double)a[row] * (double)b[row];
+            }
+            partial[(block * dimensions + first) * dimensions + second] = crossProducts;
+        }
+    });
+
+    double worst = 0;
+    for (long first = 0; first < dimensions; first++) {
+        for (long second = first + 1; second < dimensions; second++) {
+            double crossProducts = 0;
+            for (long block = 0; block < blocks; block++) {
+                crossProducts += partial[(block * dimensions + first) * dimensions + second];
+            }
+            double correlation = (crossProducts / n - mean * mean) / variance;
+            worst = std::max(worst, std::fabs(correlation));
+        }
+    }
+    return worst;
+}
+
+// Builds `candidates` designs one after another, each from its own generator stream, and keeps the
+// one with the lowest maximum absolute correlation. Every design is built and scored in parallel
+// on the pool, and a worse one is released before the next is built, so memory is two designs:
+// the one being scored and the best so far. Ties go to the lower index.
+template <class Build>
+std::vector<std::vector<long>> bestOfCandidates(const long candidates, Build build, std::mt19937& generator, double& bestScore, ThreadPool& pool) {
+    std::vector<unsigned int> seeds(candidates);
+    for (unsigned int& candidateSeed : seeds) {
+        candidateSeed = generator();
+    }
+
+    std::vector<std::vector<long>> best;
+    for (long candidate = 0; candidate < candidates; candidate++) {
+        std::seed_seq candidateSeed{ seeds[candidate] };
+        std::mt19937 candidateGenerator (candidateSeed);
+        std::vector<std::vector<long>> strata = build(candidateGenerator);
+        double score = maxAbsCorrelation(strata, pool);
+        if (candidate == 0 || score < bestScore) {
+            best.swap(strata);
+            bestScore = score;
+        }
+    }
+    return best;
+}
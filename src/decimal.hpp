@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Powers of ten up to here are exact both in a double and in 64 bits.
+constexpr int FIXED_MAX_PRECISION = 19;
+
+inline const double* exactPowersOfTen() {
+    static const double* powers = []() {
+        static double table[FIXED_MAX_PRECISION + 1];
+        table[0] = 1;
+        for (int exponent = 1; exponent <= FIXED_MAX_PRECISION; exponent++) {
+            table[exponent] = table[exponent - 1] * 10;
+        }
+        return table;
+    }();
+    return powers;
+}
+
+// "00" "01" ... "99", so that two digits are emitted per division.
+inline const char* digitPairs() {
+    static const char* pairs = []() {
+        static char table[200];
+        for (int pair = 0; pair < 100; pair++) {
+            table[2 * pair] = '0' + pair / 10;
+            table[2 * pair + 1] = '0' + pair % 10;
+        }
+        return table;
+    }();
+    return pairs;
+}
+
+// Writes exactly count digits of value ending just before end, and returns their start.
+inline char* writeDigitsBackwards(char* end, uint64_t value, int count) {
+    const char* pairs = digitPairs();
+    while (count >= 2) {
+        end -= 2;
+        std::memcpy(end, pairs + 2 * (value % 100), 2);
+        value /= 100;
+        count -= 2;
+    }
+    if (count == 1) {
+        *--end = '0' + value % 10;
+    }
+    return end;
+}
+
+inline int decimalDigitCount(uint64_t value) {
+    int count = 1;
+    while (value >= 10) {
+        value /= 10;
+        count++;
+    }
+    return count;
+}
+
+// Writes value in fixed notation with the given number of decimals, exactly as
+// printf("%.*f") or std::to_chars would, using integer arithmetic on value * 10^precision.
+// The product carries a rounding error of at most one part in 2^53. Where that error could
+// move it across a rounding boundary, or it does not fit in 52 bits, nullptr is returned
+// and the caller formats the value the general way. Grid values at the precision chosen by
+// findPrecision() are never near a boundary, so in practice they always take this path.
+inline char* formatFixed(char* out, const double value, const int precision) {
+    if (precision > FIXED_MAX_PRECISION || !std::isfinite(value)) {
+        return nullptr;
+    }
+    const double scaled = std::fabs(value) * exactPowersOfTen()[precision];
+    if (!(scaled < 0x1p52)) {
+        return nullptr;
+    }
+    const double whole = std::floor(scaled);
+    if (std::fabs(scaled - whole - 0.5) <= scaled * 0x1p-52) {
+        return nullptr;
+    }
+    const uint64_t rounded = (uint64_t)whole + (scaled - whole > 0.5 ? 1 : 0);
+
+    uint64_t integerPart = rounded;
+    uint64_t fractionPart = 0;
+    if (precision > 0) {
+        const uint64_t unit = (uint64_t)exactPowersOfTen()[precision];
+        integerPart = rounded / unit;
+        fractionPart = rounded % unit;
+    }
+
+    if (std::signbit(value)) {
+        *out++ = '-';
+    }
+    const int integerDigits = decimalDigitCount(integerPart);
+    char* end = out + integerDigits + (precision > 0 ? precision + 1 : 0);
+    if (precision > 0) {
+        writeDigitsBackwards(end, fractionPart, precision);
+        out[integerDigits] = '.';
+    }
+    writeDigitsBackwards(out + integerDigits, integerPart, integerDigits);
+    return end;
+}
@@ -0,0 +1,473 @@
+/******************************************************************************
+
+Designs and their CSV text.
+
+A design is held as its strata: one column of stratum indices per dimension,
+or, when those would not fit in memory, one random-access permutation per
+dimension that gives the stratum of any row on demand, together with what
+turns a stratum into a value. The values are computed a few
+rows at a time as the text is formatted, so no matrix of doubles is built and
+the output can start as soon as the strata are known. Blocks of rows are
+formatted in parallel and written in order.
+
+Random variance is drawn from a generator seeded per block of JITTER_BLOCK_ROWS
+rows. Any range of rows therefore gets the same values no matter where it
+starts, which keeps shards and single-file output identical.
+
+DesignBlocks exposes the values as a lazy range of row blocks for programs that
+embed the generator and pull points as they can use them. Over a design built
+by implicitDesign() it needs memory for one block only, whatever the number of
+rows, and the first block is ready as soon as it is computed.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <deque>
+#include <future>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "candidates.hpp"
+#include "decimal.hpp"
+#include "distributions.hpp"
+#include "numa.hpp"
+#include "output.hpp"
+#include "parallel.hpp"
+#include "progress.hpp"
+#include "shuffle.hpp"
+
+constexpr long JITTER_BLOCK_ROWS = 4096;
+
+// Values computed per call of designValues(), whatever the number of dimensions.
+constexpr long DESIGN_CHUNK_VALUES = 1 << 16;
+
+struct Design {
+    std::vector<std::vector<long>> strata; // one column of stratum indices per dimension
+    std::vector<RandomAccessPermutation> permutations; // instead of strata, for implicit designs
+    std::vector<double> lower;             // lower bound of each dimension
+    std::vector<double> ratio;             // width of one stratum in each dimension
+    std::vector<bool> jittered;            // whether a dimension gets random variance
+    std::vector<Marginal> marginals;
+    std::vector<int> precision;
+    unsigned int jitterSeed = 0;
+
+    long rows() const {
+        return !strata.empty() ? strata[0].size() : permutations.empty() ? 0 : permutations[0].size();
+    }
+
+    long stratum(const int dimension, const long row) const {
+        return strata.empty() ? permutations[dimension](row) : strata[dimension][row];
+    }
+
+    int dimensions() const {
+        return lower.size();
+    }
+};
+
+// Rows of a non-uniform dimension that pass through the marginal kernels at a time; they
+// are gathered into a buffer on the stack unless the dimension is already contiguous.
+constexpr long MARGINAL_BATCH_ROWS = 256;
+
+// Computes rows [firstRow, lastRow) into caller-owned memory: the value of row r and
+// dimension d goes to out[(r - firstRow) * rowStride + d * columnStride]. Row-major output
+// has columnStride 1, column-major output rowStride 1. Allocates nothing, so it may run
+// on several threads at once for different rows.
+inline void designValues(const Design& design, const long firstRow, const long lastRow, double* out, const size_t rowStride, const size_t columnStride) {
+    const int dimensions = design.dimensions();
+    const long rows = lastRow - firstRow;
+
+    const long jitteredCount = std::count(design.jittered.begin(), design.jittered.end(), true);
+    std::mt19937 generator;
+    for (long row = firstRow; row < lastRow; row++) {
+        if (jitteredCount > 0 && (row == firstRow || row % JITTER_BLOCK_ROWS == 0)) {
+            const long block = row / JITTER_BLOCK_ROWS;
+            std::seed_seq seed{ design.jitterSeed, (unsigned int)block, (unsigned int)(block >> 32) };
+            generator.seed(seed);
+            generator.discard((row - block * JITTER_BLOCK_ROWS) * jitteredCount);
+        }
+        double* point = out + (row - firstRow) * rowStride;
+        for (int dimensionIndex = 0; dimensionIndex < dimensions; dimensionIndex++) {
+            const Marginal& marginal = design.marginals[dimensionIndex];
+            double decimal = design.jittered[dimensionIndex] ? (double)(generator() % 100) / 100.0 : 0;
+
+            // probabilities for the inverse CDF stay strictly inside (0, 1); discrete levels use stratum midpoints
+            if (marginal.isDiscrete()) {
+                decimal = 0.5;
+            } else if (!marginal.isUniform()) {
+                decimal += design.jittered[dimensionIndex] ? 0.005 : 0.5;
+            }
+
+            point[dimensionIndex * columnStride] = (design.stratum(dimensionIndex, row) + decimal) * design.ratio[dimensionIndex] + design.lower[dimensionIndex];
+        }
+    }
+
+    for (int dimensionIndex = 0; dimensionIndex < dimensions; dimensionIndex++) {
+        if (design.marginals[dimensionIndex].isUniform()) {
+            continue;
+        }
+        double* column = out + dimensionIndex * columnStride;
+        if (rowStride == 1) {
+            applyMarginal(design.marginals[dimensionIndex], column, rows);
+            continue;
+        }
+        double batch[MARGINAL_BATCH_ROWS];
+        for (long batchStart = 0; batchStart < rows; batchStart += MARGINAL_BATCH_ROWS) {
+            const long batchRows = std::min(MARGINAL_BATCH_ROWS, rows - batchStart);
+            for (long row = 0; row < batchRows; row++) {
+                batch[row] = column[(batchStart + row) * rowStride];
+            }
+            applyMarginal(design.marginals[dimensionIndex], batch, batchRows);
+            for (long row = 0; row < batchRows; row++) {
+                column[(batchStart + row) * rowStride] = batch[row];
+            }
+        }
+    }
+}
+
+// Computes rows [firstRow, lastRow) into values, row-major.
+inline void designValues(const Design& design, const long firstRow, const long lastRow, std::vector<double>& values) {
+    values.resize((lastRow - firstRow) * design.dimensions());
+    designValues(design, firstRow, lastRow, values.data(), design.dimensions(), 1);
+}
+
+// Number of decimals that resolves a stratum of the given width to about 1%.
+inline int findPrecision(const double ratio) {
+    int precision = 0;
+
+    while (ratio * pow(10.0, precision) < 100.0) {
+        precision++;
+    }
+
+    return precision;
+}
+
+// A uniform design on the given scales whose strata are computed on demand, so it takes
+// constant memory for any number of rows. The same seed gives the same design as
+// `lhc --seed` when that is planned with implicit strata.
+inline Design implicitDesign(const long rows, const std::vector<std::array<double, 2>>& scales, const bool jittered, const unsigned int seed) {
+    Design design;
+    for (const std::array<double, 2>& scale : scales) {
+        design.lower.push_back(scale[0]);
+        design.ratio.push_back((scale[1] - scale[0]) / rows);
+        design.precision.push_back(findPrecision(design.ratio.back()));
+    }
+    design.jittered.assign(scales.size(), jittered);
+    design.marginals.resize(scales.size());
+
+    std::seed_seq designSeed{ seed };
+    std::mt19937 generator (designSeed);
+    design.permutations = randomPermutations(rows, scales.size(), generator);
+    design.jitterSeed = generator();
+    return design;
+}
+
+// Rows [firstRow, firstRow + rows) of a design, row-major.
+struct RowBlock {
+    long firstRow = 0;
+    long rows = 0;
+    int dimensions = 0;
+    const double* values = nullptr;
+
+    double operator()(const long row, const int dimension) const {
+        return values[row * dimensions + dimension];
+    }
+};
+
+// A lazy, single-pass range over the rows of a design in blocks of blockRows rows. Each
+// block is computed when the iterator reaches it and is valid until the iterator is
+// advanced. The design must outlive the range. The values go to scratch if given, so that
+// callers that make many ranges, such as the formatting workers, reuse one buffer.
+class DesignBlocks {
+public:
+    explicit DesignBlocks(const Design& design, const long blockRows = JITTER_BLOCK_ROWS, const long firstRow = 0, const long lastRow = -1, std::vector<double>* scratch = nullptr)
+        : design(design), blockRows(std::max(1L, blockRows)), nextRow(firstRow), lastRow(lastRow < 0 ? design.rows() : lastRow),
+          values(scratch != nullptr ? *scratch : ownValues) {}
+
+    class iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = RowBlock;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const RowBlock*;
+        using reference = const RowBlock&;
+
+        iterator() = default;
+
+        reference operator*() const {
+            return range->block;
+        }
+
+        pointer operator->() const {
+            return &range->block;
+        }
+
+        iterator& operator++() {
+            if (!range->advance()) {
+                range = nullptr;
+            }
+            return *this;
+        }
+
+        void operator++(int) {
+            ++*this;
+        }
+
+        bool operator==(const iterator& other) const {
+            return range == other.range;
+        }
+
+        bool operator!=(const iterator& other) const {
+            return range != other.range;
+        }
+
+    private:
+        friend class DesignBlocks;
+        explicit iterator(DesignBlocks* range) : range(range) {}
+
+        DesignBlocks* range = nullptr;
+    };
+
+    // Computes the first block; a range can be iterated once.
+    iterator begin() {
+        return advance() ? iterator(this) : iterator();
+    }
+
+    iterator end() {
+        return iterator();
+    }
+
+private:
+    bool advance() {
+        if (nextRow >= lastRow) {
+            return false;
+        }
+        const long blockEnd = std::min(lastRow, nextRow + blockRows);
+        designValues(design, nextRow, blockEnd, values);
+        block = {nextRow, blockEnd - nextRow, design.dimensions(), values.data()};
+        nextRow = blockEnd;
+        return true;
+    }
+
+    const Design& design;
+    const long blockRows;
+    long nextRow;
+    const long lastRow;
+    std::vector<double> ownValues;
+    std::vector<double>& values;
+    RowBlock block;
+};
+
+// Appends one value as CSV text: integers without float formatting, categorical levels by
+// label and everything else in fixed notation at the dimension's precision, through the
+// integer formatter where it is exact.
+inline void appendValue(std::string& text, const double value, const Marginal& marginal, const int precision) {
+    char digits[512];
+    char* end;
+    if (marginal.kind == MarginalKind::Integer) {
+        end = std::to_chars(digits, digits + sizeof(digits), (long long)value).ptr;
+    } else if (marginal.kind == MarginalKind::Categorical) {
+        text += marginal.labels[(long)value];
+        return;
+    } else {
+        end = formatFixed(digits, value, precision);
+        if (end == nullptr) {
+            end = std::to_chars(digits, digits + sizeof(digits), value, std::chars_format::fixed, precision).ptr;
+        }
+    }
+    text.append(digits, end - digits);
+}
+
+// Output formats: CSV text with headings, or raw native doubles row by row without
+// headings, as read back by lhc verify from .bin files.
+enum class DesignFormat { Csv, Binary };
+
+inline DesignFormat parseDesignFormat(const std::string& name) {
+    if (name == "csv") {
+        return DesignFormat::Csv;
+    }
+    if (name == "binary") {
+        return DesignFormat::Binary;
+    }
+    throw std::invalid_argument("Invalid input. Unknown output format: " + name);
+}
+
+// Appends rows [firstRow, lastRow) as raw native doubles.
+inline void appendBinaryRows(const Design& design, const long firstRow, const long lastRow, std::string& bytes) {
+    const long chunkRows = std::max<long>(1, DESIGN_CHUNK_VALUES / std::max(1, design.dimensions()));
+    thread_local std::vector<double> values;
+    for (const RowBlock& chunk : DesignBlocks(design, chunkRows, firstRow, lastRow, &values)) {
+        bytes.append(reinterpret_cast<const char*>(chunk.values), chunk.rows * chunk.dimensions * sizeof(double));
+    }
+}
+
+// Appends rows [firstRow, lastRow) as CSV text, each preceded by a newline.
+inline void formatRows(const Design& design, const long firstRow, const long lastRow, std::string& text) {
+    const int dimensions = design.dimensions();
+    const long chunkRows = std::max<long>(1, DESIGN_CHUNK_VALUES / std::max(1, dimensions));
+    thread_local std::vector<double> values; // reused by every block the thread formats
+
+    for (const RowBlock& chunk : DesignBlocks(design, chunkRows, firstRow, lastRow, &values)) {
+        for (long row = 0; row < chunk.rows; row++) {
+            text += '\n';
+            for (int dimensionIndex = 0; dimensionIndex < dimensions; dimensionIndex++) {
+                appendValue(text, chunk(row, dimensionIndex), design.marginals[dimensionIndex], design.precision[dimensionIndex]);
+                if (dimensionIndex < dimensions - 1) {
+                    text += ',';
+                }
+            }
+        }
+    }
+}
+
+// Generous estimate of the width in bytes of a CSV row, from the widest value of every
+// dimension. rows is the size of the design, which sets the width of the largest values.
+inline long rowWidth(const Design& design, const long rows) {
+    long rowBytes = 1;
+    for (int dimensionIndex = 0; dimensionIndex < design.dimensions(); dimensionIndex++) {
+        const Marginal& marginal = design.marginals[dimensionIndex];
+        if (marginal.kind == MarginalKind::Categorical) {
+            size_t longest = 0;
+            for (const std::string& label : marginal.labels) {
+                longest = std::max(longest, label.size());
+            }
+            rowBytes += longest + 1;
+        } else if (marginal.isUniform()) {
+            const double largest = std::max(std::fabs(design.lower[dimensionIndex]), std::fabs(design.lower[dimensionIndex] + design.ratio[dimensionIndex] * rows));
+            rowBytes += design.precision[dimensionIndex] + 3 + (largest >= 10 ? (long)std::log10(largest) : 0) + 1;
+        } else {
+            rowBytes += design.precision[dimensionIndex] + 8;
+        }
+    }
+    return rowBytes;
+}
+
+// Rows per output block, from rowWidth(). It depends only on the design, so the blocks,
+// and compressed output made of them, do not depend on the number of threads. Large
+// blocks are whole multiples of the jitter blocks.
+inline long rowsPerBlock(const Design& design, const long rows) {
+    long blockRows = std::max<long>(1, OUTPUT_BLOCK_SIZE / rowWidth(design, rows));
+    return blockRows > JITTER_BLOCK_ROWS ? blockRows / JITTER_BLOCK_ROWS * JITTER_BLOCK_ROWS : blockRows;
+}
+
+// Average width in bytes of a CSV row including its newline, for estimates of the output
+// size. Uniform values are as wide as the widest bound, as they mostly are.
+inline double estimatedRowBytes(const Design& design, const long rows) {
+    auto digits = [](const double value) {
+        return std::fabs(value) >= 10 ? std::floor(std::log10(std::fabs(value))) + 1 : 1.0;
+    };
+    double bytes = 0;
+    for (int dimensionIndex = 0; dimensionIndex < design.dimensions(); dimensionIndex++) {
+        const Marginal& marginal = design.marginals[dimensionIndex];
+        const int precision = design.precision[dimensionIndex];
+        bytes += 1; // the comma, or the newline after the last value
+        if (marginal.kind == MarginalKind::Categorical) {
+            double labelBytes = 0;
+            for (const std::string& label : marginal.labels) {
+                labelBytes += label.size();
+            }
+            bytes += labelBytes / std::max<size_t>(1, marginal.labels.size());
+        } else if (marginal.kind == MarginalKind::Integer) {
+            bytes += marginal.parameters.size() >= 2 ? std::max(digits(marginal.parameters[0]), digits(marginal.parameters[1])) : 8;
+        } else if (marginal.isUniform()) {
+            const double lower = design.lower[dimensionIndex];
+            const double upper = lower + design.ratio[dimensionIndex] * rows;
+            const double negative = lower < 0 ? std::min(1.0, -lower / std::max(upper - lower, 1e-300)) : 0;
+            bytes += std::max(digits(lower), digits(upper)) + (precision > 0 ? precision + 1 : 0) + negative;
+        } else {
+            bytes += precision + 4;
+        }
+    }
+    return bytes;
+}
+
+// Allocates the strata columns for a design of the given size before they are filled.
+// Under --numa first-touch the pages of every output block are placed on the node of the
+// worker that will format that block (see writeDesign()).
+inline std::vector<std::vector<long>> allocateStrata(const Design& design, const long rows, ThreadPool& pool) {
+    std::vector<std::vector<long>> strata(design.dimensions());
+    const long blockRows = rowsPerBlock(design, rows);
+    for (std::vector<long>& column : strata) {
+        column.resize(rows);
+        placeTiles(column, blockRows, pool);
+    }
+    return strata;
+}
+
+// Writes the headings and rows [firstRow, lastRow) to the sink, then finishes it. Blocks
+// of rows are formatted concurrently on the pool into their own buffers and committed to
+// the sink in row order, so the output is the same for any number of threads. At most two
+// blocks per worker are in flight, and committed buffers are reused for later blocks.
+// Block k of the design, counted from row 0, is a tile of the pool and goes to worker
+// k % workers, where allocateStrata() put its strata. Binary output has no headings.
+// Each committed block advances progress, if given, by its rows and bytes.
+inline void writeDesign(OutputSink& sink, const std::vector<std::string>& headings, const Design& design, const long firstRow, const long lastRow, ThreadPool& pool, const DesignFormat format = DesignFormat::Csv, Progress* progress = nullptr) {
+    const long blockRows = rowsPerBlock(design, design.rows());
+    std::deque<std::future<std::string>> pending;
+    std::vector<std::string> spares;
+
+    std::string text;
+    for (size_t headingIndex = 0; format == DesignFormat::Csv && headingIndex < headings.size(); headingIndex++) {
+        if (headingIndex > 0) {
+            text += ',';
+        }
+        text += headings[headingIndex];
+    }
+
+    long committedRow = firstRow;
+    auto commitOldest = [&]() {
+        std::string block = pool.await(pending.front());
+        pending.pop_front();
+        const size_t blockBytes = block.size();
+        sink.write(block);
+        if (progress != nullptr) {
+            const long rows = std::min(blockRows, lastRow - committedRow);
+            committedRow += rows;
+            progress->advance(rows, blockBytes);
+        }
+        block.clear();
+        spares.push_back(std::move(block));
+    };
+
+    try {
+        for (long blockStart = firstRow; blockStart < lastRow; blockStart += blockRows) {
+            const long blockEnd = std::min(lastRow, blockStart + blockRows);
+            if (blockStart > firstRow && !spares.empty()) {
+                text = std::move(spares.back());
+                spares.pop_back();
+            }
+            pending.push_back(pool.submit([&design, format, blockStart, blockEnd, text = std::move(text)]() mutable {
+                if (format == DesignFormat::Csv) {
+                    formatRows(design, blockStart, blockEnd, text);
+                } else {
+                    appendBinaryRows(design, blockStart, blockEnd, text);
+                }
+                return std::move(text);
+            }, blockStart / blockRows));
+            text = std::string();
+            while (pending.size() > 2 * pool.size()) {
+                commitOldest();
+            }
+        }
+        while (!pending.empty()) {
+            commitOldest();
+        }
+    } catch (...) {
+        // the tasks refer to the design, which the caller may release once this returns
+        for (std::future<std::string>& block : pending) {
+            block.wait();
+        }
+        throw;
+    }
+
+    if (firstRow == lastRow) {
+        sink.write(text);
+    }
+    sink.finish();
+}
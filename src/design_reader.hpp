@@ -0,0 +1,96 @@
+#pragma once
+
+#include <charconv>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+// A design read back from CSV, stored column by column.
+struct ExistingDesign {
+    std::vector<std::string> headings;
+    std::vector<std::vector<double>> columns;
+    long rows = 0;
+};
+
+// Reads a CSV design written by lhc (or any numeric CSV with an optional heading row).
+// The whole file is read in one call and parsed in place with std::from_chars.
+inline ExistingDesign readDesign(const std::string& path) {
+    std::ifstream in(path, std::ios::in | std::ios::binary);
+    if (!in.is_open()) {
+        throw std::invalid_argument("Invalid input. Cannot open design file: " + path);
+    }
+    std::string text;
+    in.seekg(0, std::ios::end);
+    text.resize(in.tellg());
+    in.seekg(0, std::ios::beg);
+    in.read(&text[0], text.size());
+
+    ExistingDesign design;
+    const char* cursor = text.data();
+    const char* const end = text.data() + text.size();
+    long lineNumber = 0;
+
+    auto lineEnd = [&](const char* from) {
+        const char* newline = from;
+        while (newline < end && *newline != '\n') {
+            newline++;
+        }
+        return newline;
+    };
+
+    // the first line is a heading row unless every field in it is a number
+    const char* firstEnd = lineEnd(cursor);
+    const char* field = cursor;
+    bool numeric = true;
+    std::vector<std::string> firstFields;
+    while (field <= firstEnd) {
+        const char* comma = field;
+        while (comma < firstEnd && *comma != ',') {
+            comma++;
+        }
+        const char* fieldEnd = (comma > field && comma[-1] == '\r') ? comma - 1 : comma;
+        double value;
+        auto [parsed, error] = std::from_chars(field, fieldEnd, value);
+        numeric = numeric && error == std::errc() && parsed == fieldEnd;
+        firstFields.emplace_back(field, fieldEnd);
+        field = comma + 1;
+    }
+    const int columns = firstFields.size();
+    design.columns.resize(columns);
+    if (!numeric) {
+        design.headings = firstFields;
+        cursor = firstEnd < end ? firstEnd + 1 : end;
+        lineNumber++;
+    }
+
+    while (cursor < end) {
+        lineNumber++;
+        const char* rowEnd = lineEnd(cursor);
+        if (rowEnd == cursor || (rowEnd == cursor + 1 && *cursor == '\r')) {
+            cursor = rowEnd + 1; // skip blank lines
+            continue;
+        }
+        for (int columnIndex = 0; columnIndex < columns; columnIndex++) {
+            double value;
+            auto [parsed, error] = std::from_chars(cursor, rowEnd, value);
+            if (error != std::errc()) {
+                throw std::invalid_argument("Invalid design file. Line " + std::to_string(lineNumber) + " column " + std::to_string(columnIndex) + " is not a number.");
+            }
+            char expected = columnIndex + 1 < columns ? ',' : '\n';
+            if (parsed < rowEnd && *parsed == '\r') {
+                parsed++;
+            }
+            if ((parsed < rowEnd ? *parsed : '\n') != expected) {
+                throw std::invalid_argument("Invalid design file. Line " + std::to_string(lineNumber) + " does not have " + std::to_string(columns) + " columns.");
+            }
+            design.columns[columnIndex].push_back(value);
+            cursor = parsed + 1;
+        }
+        cursor = rowEnd + 1;
+        design.rows++;
+    }
+
+    return design;
+}
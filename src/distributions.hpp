@@ -0,0 +1,505 @@
+/******************************************************************************
+
+Inverse-CDF marginal distributions.
+
+A dimension with a non-uniform marginal is first stratified on (0, 1), exactly
+like a uniform dimension scaled to 0:1, and the column of probabilities is then
+mapped through the inverse CDF in place. The kernels are written with GCC
+vector extensions, LANES values at a time, using branch-free log/exp/normal
+quantile approximations; the only scalar kernel is the beta quantile, which
+has no closed form and is solved by safeguarded Newton iteration. Empirical
+marginals interpolate a precomputed quantile table built from a sample file.
+
+Integer and categorical dimensions are discrete marginals: stratum k of N maps
+to level floor((k + 1/2) L / N) of L, so every level is used either floor(N/L)
+or ceil(N/L) times.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "empirical.hpp"
+
+// 128-bit lanes are native on every 64-bit target (SSE2, NEON).
+typedef double DoubleLanes __attribute__((vector_size(16)));
+typedef long long LongLanes __attribute__((vector_size(16)));
+constexpr int LANES = sizeof(DoubleLanes) / sizeof(double);
+
+inline DoubleLanes splat(const double value) {
+    return DoubleLanes{} + value;
+}
+
+// Natural logarithm for positive, normal inputs; about 1 ulp.
+inline DoubleLanes lanesLog(const DoubleLanes x) {
+    LongLanes bits = (LongLanes)x;
+    LongLanes exponent = ((bits >> 52) & 0x7ff) - 1023;
+    DoubleLanes mantissa = (DoubleLanes)((bits & 0x000fffffffffffffLL) | 0x3ff0000000000000LL); // [1, 2)
+
+    // centre the mantissa on 1 so the series below converges quickly
+    LongLanes high = mantissa > splat(1.4142135623730951);
+    mantissa = high ? mantissa * 0.5 : mantissa;
+    exponent = exponent - high; // comparison masks are -1 where true
+
+    const DoubleLanes t = (mantissa - 1.0) / (mantissa + 1.0);
+    const DoubleLanes t2 = t * t;
+    DoubleLanes series = splat(1.0 / 21);
+    series = series * t2 + 1.0 / 19;
+    series = series * t2 + 1.0 / 17;
+    series = series * t2 + 1.0 / 15;
+    series = series * t2 + 1.0 / 13;
+    series = series * t2 + 1.0 / 11;
+    series = series * t2 + 1.0 / 9;
+    series = series * t2 + 1.0 / 7;
+    series = series * t2 + 1.0 / 5;
+    series = series * t2 + 1.0 / 3;
+    series = series * t2 + 1.0;
+    return __builtin_convertvector(exponent, DoubleLanes) * 0.6931471805599453 + 2.0 * t * series;
+}
+
+// Exponential, clamped to the finite double range.
+inline DoubleLanes lanesExp(DoubleLanes x) {
+    x = x > splat(709.0) ? splat(709.0) : x;
+    x = x < splat(-708.0) ? splat(-708.0) : x;
+
+    // x = k ln2 + r with |r| <= ln2 / 2, ln2 split in two parts for an exact reduction
+    DoubleLanes k = x * 1.4426950408889634 + 6755399441055744.0 - 6755399441055744.0; // round to nearest
+    DoubleLanes r = x - k * 0.6931471803691238 - k * 1.9082149292705877e-10;
+
+    DoubleLanes series = splat(1.0 / 479001600);
+    series = series * r + 1.0 / 39916800;
+    series = series * r + 1.0 / 3628800;
+    series = series * r + 1.0 / 362880;
+    series = series * r + 1.0 / 40320;
+    series = series * r + 1.0 / 5040;
+    series = series * r + 1.0 / 720;
+    series = series * r + 1.0 / 120;
+    series = series * r + 1.0 / 24;
+    series = series * r + 1.0 / 6;
+    series = series * r + 0.5;
+    series = series * r + 1.0;
+    series = series * r + 1.0;
+
+    LongLanes scale = (__builtin_convertvector(k, LongLanes) + 1023) << 52;
+    return series * (DoubleLanes)scale;
+}
+
+inline DoubleLanes lanesSqrt(DoubleLanes x) {
+    for (int lane = 0; lane < LANES; lane++) {
+        x[lane] = std::sqrt(x[lane]);
+    }
+    return x;
+}
+
+template <int DEGREE>
+inline DoubleLanes polynomial(const DoubleLanes x, const double (&coefficients)[DEGREE]) {
+    DoubleLanes sum = splat(coefficients[DEGREE - 1]);
+    for (int i = DEGREE - 2; i >= 0; i--) {
+        sum = sum * x + coefficients[i];
+    }
+    return sum;
+}
+
+// Standard normal quantile, Wichura's AS 241 (PPND16), accurate to about 1e-16.
+// Every lane evaluates both the central and the tail approximation and selects one.
+inline DoubleLanes lanesInverseNormal(const DoubleLanes p) {
+    static const double centralNumerator[] = {
+        3.387132872796366608, 133.14166789178437745, 1971.5909503065514427, 13731.693765509461125,
+        45921.953931549871457, 67265.770927008700853, 33430.575583588128105, 2509.0809287301226727};
+    static const double centralDenominator[] = {
+        1.0, 42.313330701600911252, 687.1870074920579083, 5394.1960214247511077,
+        21213.794301586595867, 39307.89580009271061, 28729.085735721942674, 5226.495278852545925};
+    static const double nearNumerator[] = {
+        1.42343711074968357734, 4.6303378461565452959, 5.7694972214606914055, 3.64784832476320460504,
+        1.27045825245236838258, 0.24178072517745061177, 0.0227238449892691845833, 7.7454501427834140764e-4};
+    static const double nearDenominator[] = {
+        1.0, 2.05319162663775882187, 1.6763848301838038494, 0.68976733498510000455,
+        0.14810397642748007459, 0.0151986665636164571966, 5.475938084995344946e-4, 1.05075007164441684324e-9};
+    static const double farNumerator[] = {
+        6.6579046435011037772, 5.4637849111641143699, 1.7848265399172913358, 0.29656057182850489123,
+        0.026532189526576123093, 0.0012426609473880784386, 2.71155556874348757815e-5, 2.01033439929228813265e-7};
+    static const double farDenominator[] = {
+        1.0, 0.59983220655588793769, 0.13692988092273580531, 0.0148753612908506148525,
+        7.868691311456132591e-4, 1.8463183175100546818e-5, 1.4215117583164458887e-7, 2.04426310338993978564e-15};
+
+    const DoubleLanes q = p - 0.5;
+    const DoubleLanes centralR = 0.180625 - q * q;
+    const DoubleLanes central = q * polynomial(centralR, centralNumerator) / polynomial(centralR, centralDenominator);
+
+    const DoubleLanes smaller = q < splat(0.0) ? p : 1.0 - p;
+    const DoubleLanes r = lanesSqrt(-lanesLog(smaller > splat(1e-300) ? smaller : splat(1e-300)));
+    const DoubleLanes nearR = r - 1.6;
+    const DoubleLanes farR = r - 5.0;
+    const DoubleLanes near = polynomial(nearR, nearNumerator) / polynomial(nearR, nearDenominator);
+    const DoubleLanes far = polynomial(farR, farNumerator) / polynomial(farR, farDenominator);
+    DoubleLanes tail = r <= splat(5.0) ? near : far;
+    tail = q < splat(0.0) ? -tail : tail;
+
+    return q * q <= splat(0.425 * 0.425) ? central : tail;
+}
+
+// Applies kernel to values[0..count) in blocks of LANES; the ragged end is padded with 0.5.
+template <class Kernel>
+void applyLanes(double* values, const long count, Kernel kernel) {
+    long index = 0;
+    for (; index + LANES <= count; index += LANES) {
+        DoubleLanes block;
+        std::memcpy(&block, values + index, sizeof(block));
+        block = kernel(block);
+        std::memcpy(values + index, &block, sizeof(block));
+    }
+    if (index < count) {
+        DoubleLanes block = splat(0.5);
+        std::memcpy(&block, values + index, (count - index) * sizeof(double));
+        block = kernel(block);
+        std::memcpy(values + index, &block, (count - index) * sizeof(double));
+    }
+}
+
+inline double normalCDF(const double z) {
+    return 0.5 * std::erfc(-z / std::sqrt(2.0));
+}
+
+// Regularized incomplete beta function I_x(a, b), continued fraction evaluated with Lentz's method.
+inline double incompleteBeta(const double a, const double b, const double x, const double logBeta) {
+    if (x <= 0) {
+        return 0;
+    }
+    if (x >= 1) {
+        return 1;
+    }
+    // the fraction converges fastest below the mean; use the symmetry relation above it
+    if (x > (a + 1) / (a + b + 2)) {
+        return 1 - incompleteBeta(b, a, 1 - x, logBeta);
+    }
+
+    const double tiny = 1e-300;
+    const double front = std::exp(a * std::log(x) + b * std::log1p(-x) - logBeta) / a;
+    double f = 1, c = 1, d = 0;
+    for (int m = 0; m <= 300; m++) {
+        double numerator;
+        if (m == 0) {
+            numerator = 1;
+        } else if (m % 2 == 0) {
+            int k = m / 2;
+            numerator = (k * (b - k) * x) / ((a + 2 * k - 1) * (a + 2 * k));
+        } else {
+            int k = (m - 1) / 2;
+            numerator = -((a + k) * (a + b + k) * x) / ((a + 2 * k) * (a + 2 * k + 1));
+        }
+        d = 1 + numerator * d;
+        d = std::fabs(d) < tiny ? tiny : d;
+        d = 1 / d;
+        c = 1 + numerator / c;
+        c = std::fabs(c) < tiny ? tiny : c;
+        double delta = c * d;
+        f *= delta;
+        if (std::fabs(delta - 1) < 1e-15) {
+            break;
+        }
+    }
+    return front * (f - 1);
+}
+
+// Beta quantile: Newton steps on I_x(a, b) = p, falling back to bisection whenever a step
+// would leave the current bracket.
+inline double inverseBeta(const double p, const double a, const double b, const double logBeta) {
+    double low = 0, high = 1;
+    double x = a / (a + b);
+    for (int iteration = 0; iteration < 200; iteration++) {
+        double error = incompleteBeta(a, b, x, logBeta) - p;
+        if (error == 0) {
+            break;
+        }
+        if (error < 0) {
+            low = x;
+        } else {
+            high = x;
+        }
+        double density = std::exp((a - 1) * std::log(x) + (b - 1) * std::log1p(-x) - logBeta);
+        double next = x - error / density;
+        if (!(next > low && next < high)) {
+            next = 0.5 * (low + high);
+        }
+        if (std::fabs(next - x) <= 1e-15 * std::max(x, 1e-300) || high - low <= 1e-15 * high) {
+            x = next;
+            break;
+        }
+        x = next;
+    }
+    return x;
+}
+
+enum class MarginalKind { Uniform, Normal, LogNormal, LogUniform, Triangular, Beta, TruncatedNormal, Empirical, Integer, Categorical };
+
+// The marginal distribution of one dimension, as given in --scales.
+struct Marginal {
+    MarginalKind kind = MarginalKind::Uniform;
+    std::string name = "uniform";
+    std::vector<double> parameters;
+    std::string source;                         // sample file of an empirical marginal
+    std::shared_ptr<const QuantileTable> table; // its quantile table, shared between copies
+    std::vector<std::string> labels;            // levels of a categorical marginal
+
+    bool isUniform() const {
+        return kind == MarginalKind::Uniform;
+    }
+
+    // discrete marginals ignore random variance, which would unbalance the level counts
+    bool isDiscrete() const {
+        return kind == MarginalKind::Integer || kind == MarginalKind::Categorical;
+    }
+};
+
+inline Marginal makeMarginal(const std::string& name, const std::vector<std::string>& arguments) {
+    if (name == "empirical") {
+        if (arguments.empty()) {
+            throw std::invalid_argument("Invalid distribution format in --scales, use dim:empirical:path");
+        }
+        Marginal marginal;
+        marginal.kind = MarginalKind::Empirical;
+        marginal.name = name;
+        for (size_t i = 0; i < arguments.size(); i++) {
+            marginal.source += (i ? ":" : "") + arguments[i]; // paths may contain ':'
+        }
+        marginal.table = std::make_shared<const QuantileTable>(buildQuantileTable(marginal.source));
+        return marginal;
+    }
+
+    if (name == "cat") {
+        Marginal marginal;
+        marginal.kind = MarginalKind::Categorical;
+        marginal.name = name;
+        std::string joined;
+        for (size_t i = 0; i < arguments.size(); i++) {
+            joined += (i ? ":" : "") + arguments[i];
+        }
+        size_t start = 0;
+        while (start <= joined.size()) {
+            size_t bar = std::min(joined.find('|', start), joined.size());
+            marginal.labels.push_back(joined.substr(start, bar - start));
+            start = bar + 1;
+        }
+        for (const std::string& label : marginal.labels) {
+            if (label.empty()) {
+                throw std::invalid_argument("Invalid distribution format in --scales, use dim:cat:a|b|c");
+            }
+        }
+        return marginal;
+    }
+
+    if (name == "int") {
+        if (arguments.size() != 2) {
+            throw std::invalid_argument("Invalid distribution format in --scales, use dim:int:lower:upper");
+        }
+        Marginal marginal;
+        marginal.kind = MarginalKind::Integer;
+        marginal.name = name;
+        long lower = std::stol(arguments[0]), upper = std::stol(arguments[1]);
+        if (lower > upper) {
+            throw std::invalid_argument("Invalid parameters in --scales for int, use dim:int:lower:upper");
+        }
+        marginal.parameters = {(double)lower, (double)upper};
+        return marginal;
+    }
+
+    struct Signature { const char* name; MarginalKind kind; size_t minimum; size_t maximum; const char* usage; };
+    static const Signature signatures[] = {
+        {"uniform", MarginalKind::Uniform, 2, 2, "uniform:lower:upper"},
+        {"normal", MarginalKind::Normal, 2, 2, "normal:mean:stddev"},
+        {"lognormal", MarginalKind::LogNormal, 2, 2, "lognormal:mu:sigma"},
+        {"loguniform", MarginalKind::LogUniform, 2, 2, "loguniform:lower:upper"},
+        {"triangular", MarginalKind::Triangular, 3, 3, "triangular:lower:mode:upper"},
+        {"beta", MarginalKind::Beta, 2, 4, "beta:alpha:beta[:lower:upper]"},
+        {"truncnormal", MarginalKind::TruncatedNormal, 4, 4, "truncnormal:mean:stddev:lower:upper"},
+    };
+
+    const Signature* signature = nullptr;
+    for (const Signature& candidate : signatures) {
+        if (name == candidate.name) {
+            signature = &candidate;
+        }
+    }
+    if (signature == nullptr) {
+        throw std::invalid_argument("Invalid distribution in --scales: " + name);
+    }
+    if (arguments.size() < signature->minimum || arguments.size() > signature->maximum || (signature->kind == MarginalKind::Beta && arguments.size() == 3)) {
+        throw std::invalid_argument("Invalid distribution format in --scales, use dim:" + std::string(signature->usage));
+    }
+
+    Marginal marginal;
+    marginal.kind = signature->kind;
+    marginal.name = signature->name;
+    for (const std::string& argument : arguments) {
+        marginal.parameters.push_back(std::stod(argument));
+    }
+    std::vector<double>& p = marginal.parameters;
+
+    bool valid = true;
+    switch (marginal.kind) {
+        case MarginalKind::Uniform:
+            valid = p[0] <= p[1];
+            break;
+        case MarginalKind::Normal:
+        case MarginalKind::LogNormal:
+            valid = p[1] > 0;
+            break;
+        case MarginalKind::LogUniform:
+            valid = p[0] > 0 && p[0] <= p[1];
+            break;
+        case MarginalKind::Triangular:
+            valid = p[0] <= p[1] && p[1] <= p[2] && p[0] < p[2];
+            break;
+        case MarginalKind::Beta:
+            if (p.size() == 2) {
+                p.push_back(0);
+                p.push_back(1);
+            }
+            valid = p[0] > 0 && p[1] > 0 && p[2] < p[3];
+            break;
+        case MarginalKind::TruncatedNormal:
+            valid = p[1] > 0 && p[2] < p[3];
+            break;
+        case MarginalKind::Empirical:
+        case MarginalKind::Integer:
+        case MarginalKind::Categorical:
+            break;
+    }
+    if (!valid) {
+        throw std::invalid_argument("Invalid parameters in --scales for " + marginal.name + ", use dim:" + signature->usage);
+    }
+    return marginal;
+}
+
+inline std::string describeMarginal(const Marginal& marginal) {
+    std::ostringstream description;
+    if (marginal.kind == MarginalKind::Empirical) {
+        description << marginal.name << "(" << marginal.source << ", " << marginal.table->samples << " samples)";
+        return description.str();
+    }
+    if (marginal.kind == MarginalKind::Categorical) {
+        description << marginal.name << "(";
+        for (size_t i = 0; i < marginal.labels.size(); i++) {
+            description << (i ? "|" : "") << marginal.labels[i];
+        }
+        description << ")";
+        return description.str();
+    }
+    description << marginal.name << "(";
+    for (size_t i = 0; i < marginal.parameters.size(); i++) {
+        description << (i ? ", " : "") << marginal.parameters[i];
+    }
+    description << ")";
+    return description.str();
+}
+
+// Maps probabilities in (0, 1) to the marginal's coordinates, in place.
+inline void applyMarginal(const Marginal& marginal, double* values, const long count) {
+    const std::vector<double>& p = marginal.parameters;
+    switch (marginal.kind) {
+        case MarginalKind::Uniform: {
+            const double lower = p[0], width = p[1] - p[0];
+            applyLanes(values, count, [=](DoubleLanes u) { return lower + u * width; });
+            break;
+        }
+        case MarginalKind::Normal: {
+            const double mean = p[0], deviation = p[1];
+            applyLanes(values, count, [=](DoubleLanes u) { return mean + deviation * lanesInverseNormal(u); });
+            break;
+        }
+        case MarginalKind::LogNormal: {
+            const double mu = p[0], sigma = p[1];
+            applyLanes(values, count, [=](DoubleLanes u) { return lanesExp(mu + sigma * lanesInverseNormal(u)); });
+            break;
+        }
+        case MarginalKind::LogUniform: {
+            const double logLower = std::log(p[0]), logWidth = std::log(p[1]) - std::log(p[0]);
+            applyLanes(values, count, [=](DoubleLanes u) { return lanesExp(logLower + u * logWidth); });
+            break;
+        }
+        case MarginalKind::Triangular: {
+            const double lower = p[0], mode = p[1], upper = p[2];
+            const double split = (mode - lower) / (upper - lower);
+            const double leftArea = (upper - lower) * (mode - lower), rightArea = (upper - lower) * (upper - mode);
+            applyLanes(values, count, [=](DoubleLanes u) {
+                DoubleLanes left = lower + lanesSqrt(u * leftArea);
+                DoubleLanes right = upper - lanesSqrt((1.0 - u) * rightArea);
+                return u < splat(split) ? left : right;
+            });
+            break;
+        }
+        case MarginalKind::Beta: {
+            const double a = p[0], b = p[1], lower = p[2], width = p[3] - p[2];
+            const double logBeta = std::lgamma(a) + std::lgamma(b) - std::lgamma(a + b);
+            for (long index = 0; index < count; index++) {
+                values[index] = lower + width * inverseBeta(values[index], a, b, logBeta);
+            }
+            break;
+        }
+        case MarginalKind::TruncatedNormal: {
+            // An interval above the mean is sampled in the upper tail, through Q = 1 - Phi, since
+            // Phi itself rounds to 1 there: x = mean - deviation * inverseNormal(Q(a) - u (Q(a) - Q(b))).
+            // That is the lower-tail formula mirrored about the mean, and still increasing in u.
+            const double lower = p[2], upper = p[3];
+            const double mean = p[0];
+            const bool upperTail = lower + upper > 2 * mean;
+            const double deviation = upperTail ? -p[1] : p[1];
+            const double start = normalCDF((lower - mean) / deviation);
+            const double mass = normalCDF((upper - mean) / deviation) - start;
+            applyLanes(values, count, [=](DoubleLanes u) {
+                DoubleLanes x = mean + deviation * lanesInverseNormal(start + u * mass);
+                x = x < splat(lower) ? splat(lower) : x;
+                return x > splat(upper) ? splat(upper) : x;
+            });
+            break;
+        }
+        case MarginalKind::Empirical: {
+            const QuantileTable& table = *marginal.table;
+            for (long index = 0; index < count; index++) {
+                values[index] = table(values[index]);
+            }
+            break;
+        }
+        case MarginalKind::Integer:
+        case MarginalKind::Categorical: {
+            // integers hold the value itself, categories the index of their label
+            const double first = marginal.kind == MarginalKind::Integer ? p[0] : 0;
+            const double levels = marginal.kind == MarginalKind::Integer ? p[1] - p[0] + 1 : marginal.labels.size();
+            applyLanes(values, count, [=](DoubleLanes u) {
+                DoubleLanes level = __builtin_convertvector(__builtin_convertvector(u * levels, LongLanes), DoubleLanes);
+                level = level > splat(levels - 1) ? splat(levels - 1) : level;
+                return first + level;
+            });
+            break;
+        }
+    }
+}
+
+// Smallest stratum width of the marginal on an N-level grid, probed at the ends and quartiles.
+// Used in place of the uniform `ratio` to choose the output precision.
+inline double marginalResolution(const Marginal& marginal, const long strataCount) {
+    std::vector<double> probes;
+    for (double fraction : {0.0, 0.25, 0.5, 0.75, 1.0}) {
+        long stratum = std::min(strataCount - 1, (long)(fraction * strataCount));
+        probes.push_back((stratum + 0.25) / strataCount);
+        probes.push_back((stratum + 0.75) / strataCount);
+    }
+    applyMarginal(marginal, probes.data(), probes.size());
+
+    double resolution = std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i < probes.size(); i += 2) {
+        double width = 2 * std::fabs(probes[i + 1] - probes[i]);
+        if (width > 0 && std::isfinite(width)) {
+            resolution = std::min(resolution, width);
+        }
+    }
+    return std::isfinite(resolution) ? resolution : 1.0;
+}
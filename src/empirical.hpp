@@ -0,0 +1,260 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+#include "mapped_file.hpp"
+
+// Interpolated empirical quantile function of a reference sample. The table holds the
+// sample quantiles at evenly spaced probabilities, so a lookup is one multiply, one
+// index and one linear interpolation regardless of the size of the sample.
+struct QuantileTable {
+    std::vector<double> knots;
+    long samples = 0;
+
+    double operator()(const double probability) const {
+        const double position = probability * (knots.size() - 1);
+        long index = std::min<long>(std::max(0.0, position), knots.size() - 2);
+        return knots[index] + (position - index) * (knots[index + 1] - knots[index]);
+    }
+};
+
+// Largest table kept; smaller samples are stored whole and interpolated exactly.
+constexpr long QUANTILE_TABLE_SIZE = 65537;
+
+// Largest sample that is read into memory whole, 64 MiB; larger ones are selected from in
+// passes over the file.
+constexpr long QUANTILE_RESERVOIR_SIZE = 1 << 23;
+constexpr size_t QUANTILE_SPLITTER_GROUP = 32;
+
+// Calls visit(value) for every sample of a mapped file, in order. Files ending in ".bin"
+// hold raw native doubles; anything else is text with numbers separated by whitespace or
+// commas, and an optional non-numeric heading on the first line.
+inline bool isBinarySampleFile(const std::string& path) {
+    return path.size() > 4 && path.compare(path.size() - 4, 4, ".bin") == 0;
+}
+
+template <class Visit>
+void forEachSample(const MappedFile& file, const std::string& path, Visit visit) {
+    if (isBinarySampleFile(path)) {
+        const size_t count = file.size() / sizeof(double);
+        for (size_t index = 0; index < count; index++) {
+            double value;
+            std::memcpy(&value, file.data() + index * sizeof(double), sizeof(double));
+            visit(value);
+        }
+        return;
+    }
+
+    const char* cursor = file.data();
+    const char* const end = file.data() + file.size();
+    bool firstLine = true;
+    while (cursor < end) {
+        if (std::isspace((unsigned char)*cursor) || *cursor == ',') {
+            firstLine = firstLine && *cursor != '\n';
+            cursor++;
+            continue;
+        }
+        double value;
+        auto [parsed, error] = std::from_chars(cursor, end, value);
+        if (error != std::errc()) {
+            if (!firstLine) {
+                throw std::invalid_argument("Invalid input. Non-numeric value in sample file: " + path);
+            }
+            cursor = std::find(cursor, end, '\n'); // heading
+            continue;
+        }
+        visit(value);
+        cursor = parsed;
+    }
+}
+
+// Places the order statistics of the given ranks (sorted ascending) at those positions,
+// one nth_element per rank on shrinking ranges: O(n log k) rather than a full sort.
+inline void selectRanks(std::vector<double>& values, const long first, const long last, const std::vector<long>& ranks, const size_t low, const size_t high) {
+    if (low >= high || first >= last) {
+        return;
+    }
+    const size_t middle = low + (high - low) / 2;
+    const long rank = ranks[middle];
+    std::nth_element(values.begin() + first, values.begin() + rank, values.begin() + last);
+    selectRanks(values, first, rank, ranks, low, middle);
+    selectRanks(values, rank + 1, last, ranks, middle + 1, high);
+}
+
+// The ranks of the order statistics that the knots of a table for n samples interpolate,
+// ascending and without duplicates.
+inline std::vector<long> knotRanks(const long n) {
+    std::vector<long> ranks;
+    for (long knot = 0; knot < QUANTILE_TABLE_SIZE; knot++) {
+        long rank = (long)((double)knot / (QUANTILE_TABLE_SIZE - 1) * (n - 1));
+        ranks.push_back(rank);
+        ranks.push_back(std::min(rank + 1, n - 1));
+    }
+    ranks.erase(std::unique(ranks.begin(), ranks.end()), ranks.end());
+    return ranks;
+}
+
+// Knot j is the linearly interpolated sample quantile at probability j / (K - 1), from the
+// order statistics of knotRanks(n) given by orderStatistic(rank).
+template <class OrderStatistic>
+QuantileTable interpolateKnots(const long n, OrderStatistic orderStatistic) {
+    QuantileTable table;
+    table.samples = n;
+    table.knots.resize(QUANTILE_TABLE_SIZE);
+    for (long knot = 0; knot < QUANTILE_TABLE_SIZE; knot++) {
+        double position = (double)knot / (QUANTILE_TABLE_SIZE - 1) * (n - 1);
+        long rank = (long)position;
+        double next = orderStatistic(std::min(rank + 1, n - 1));
+        double value = orderStatistic(rank);
+        table.knots[knot] = value + (position - rank) * (next - value);
+    }
+    return table;
+}
+
+inline QuantileTable buildQuantileTable(std::vector<double> samples) {
+    const long n = samples.size();
+    if (n < 2) {
+        throw std::invalid_argument("Invalid input. An empirical distribution needs at least two samples.");
+    }
+
+    if (n <= QUANTILE_TABLE_SIZE) {
+        QuantileTable table;
+        table.samples = n;
+        std::sort(samples.begin(), samples.end());
+        table.knots = std::move(samples);
+        return table;
+    }
+
+    const std::vector<long> ranks = knotRanks(n);
+    selectRanks(samples, 0, n, ranks, 0, ranks.size());
+    return interpolateKnots(n, [&](const long rank) { return samples[rank]; });
+}
+
+// The number of leading values of a sorted array that are not above value, like
+// upper_bound but without branches, which the comparisons of random samples would mispredict.
+inline size_t countNotAbove(const double* values, size_t length, const double value) {
+    if (length == 0) {
+        return 0;
+    }
+    const double* base = values;
+    while (length > 1) {
+        const size_t half = length / 2;
+        base += (size_t)(base[half - 1] <= value) * half;
+        length -= half;
+    }
+    return (base - values) + (size_t)(*base <= value);
+}
+
+// Builds the table of a sample file through a memory map. A sample of up to
+// QUANTILE_RESERVOIR_SIZE values is read whole. A larger one is never copied: the first
+// pass counts it and draws a random reservoir, whose sorted values give about sqrt(n K)
+// splitters; the second counts the samples between consecutive splitters; the third
+// collects only the buckets that hold one of the ranks the knots need. The knots are the
+// same exact order statistics as for a sample in memory, with O(sqrt(n K)) memory rather
+// than n values, at the cost of a bucket search per sample in two passes, several times
+// the time of copying. Samples equal to a bucket's lower splitter are only counted, so
+// that a heavily repeated value does not fill a bucket.
+inline QuantileTable buildQuantileTable(const std::string& path) {
+    MappedFile file(path);
+
+    // at most one value per two bytes of text
+    std::vector<double> reservoir;
+    reservoir.reserve(std::min<size_t>(QUANTILE_RESERVOIR_SIZE, file.size() / (isBinarySampleFile(path) ? sizeof(double) : 2) + 1));
+    std::mt19937_64 generator(QUANTILE_RESERVOIR_SIZE); // a fixed seed: the table does not depend on it anyway
+    long n = 0;
+    forEachSample(file, path, [&](const double value) {
+        if (n < QUANTILE_RESERVOIR_SIZE) {
+            reservoir.push_back(value);
+        } else {
+            const uint64_t slot = generator() % (uint64_t)(n + 1);
+            if (slot < (uint64_t)QUANTILE_RESERVOIR_SIZE) {
+                reservoir[slot] = value;
+            }
+        }
+        n++;
+    });
+    if (n <= QUANTILE_RESERVOIR_SIZE) {
+        return buildQuantileTable(std::move(reservoir));
+    }
+
+    // bucket b holds the samples v with splitters[b - 1] <= v < splitters[b]
+    std::sort(reservoir.begin(), reservoir.end());
+    const long buckets = std::min<long>(QUANTILE_RESERVOIR_SIZE, std::sqrt((double)n * QUANTILE_TABLE_SIZE));
+    std::vector<double> splitters(buckets - 1);
+    for (long index = 0; index < buckets - 1; index++) {
+        splitters[index] = reservoir[(index + 1) * QUANTILE_RESERVOIR_SIZE / buckets];
+    }
+    std::vector<double>().swap(reservoir);
+    // upper_bound on every 32nd splitter, which stays in cache, and then on the 31 after it
+    std::vector<double> coarse;
+    for (size_t index = QUANTILE_SPLITTER_GROUP - 1; index < splitters.size(); index += QUANTILE_SPLITTER_GROUP) {
+        coarse.push_back(splitters[index]);
+    }
+    auto bucketOf = [&](const double value) {
+        const size_t first = countNotAbove(coarse.data(), coarse.size(), value) * QUANTILE_SPLITTER_GROUP;
+        const size_t length = std::min(splitters.size(), first + QUANTILE_SPLITTER_GROUP - 1) - first;
+        return (long)(first + countNotAbove(splitters.data() + first, length, value));
+    };
+    auto isTie = [&](const long bucket, const double value) {
+        return bucket > 0 && value == splitters[bucket - 1];
+    };
+
+    std::vector<long> firstRanks(buckets + 1); // counts, then the first rank of every bucket
+    std::vector<long> ties(buckets);
+    forEachSample(file, path, [&](const double value) {
+        const long bucket = bucketOf(value);
+        firstRanks[bucket + 1]++;
+        ties[bucket] += isTie(bucket, value);
+    });
+    for (long bucket = 0; bucket < buckets; bucket++) {
+        firstRanks[bucket + 1] += firstRanks[bucket];
+    }
+    auto bucketOfRank = [&](const long rank) {
+        return std::upper_bound(firstRanks.begin(), firstRanks.end(), rank) - firstRanks.begin() - 1;
+    };
+
+    // the buckets whose samples besides the ties are needed, ascending, and where each
+    // one's samples start in values
+    const std::vector<long> ranks = knotRanks(n);
+    std::vector<bool> isWanted(buckets);
+    std::vector<long> wanted;
+    std::vector<long> starts{0};
+    for (const long rank : ranks) {
+        const long bucket = bucketOfRank(rank);
+        if (!isWanted[bucket] && rank - firstRanks[bucket] >= ties[bucket]) {
+            isWanted[bucket] = true;
+            wanted.push_back(bucket);
+            starts.push_back(starts.back() + firstRanks[bucket + 1] - firstRanks[bucket] - ties[bucket]);
+        }
+    }
+    auto wantedIndex = [&](const long bucket) {
+        return std::lower_bound(wanted.begin(), wanted.end(), bucket) - wanted.begin();
+    };
+
+    std::vector<double> values(starts.back());
+    std::vector<long> cursors(starts.begin(), starts.end() - 1);
+    forEachSample(file, path, [&](const double value) {
+        const long bucket = bucketOf(value);
+        if (isWanted[bucket] && !isTie(bucket, value)) {
+            values[cursors[wantedIndex(bucket)]++] = value;
+        }
+    });
+    for (size_t index = 0; index < wanted.size(); index++) {
+        std::sort(values.begin() + starts[index], values.begin() + starts[index + 1]);
+    }
+
+    return interpolateKnots(n, [&](const long rank) {
+        const long bucket = bucketOfRank(rank);
+        const long offset = rank - firstRanks[bucket];
+        return offset < ties[bucket] ? splitters[bucket - 1] : values[starts[wantedIndex(bucket)] + offset - ties[bucket]];
+    });
+}
@@ -0,0 +1,168 @@
+/******************************************************************************
+
+The C interface declared in include/lhc.h.
+
+The library is the command line program without main(): a generator runs the
+same option handling as lhc (runJob()), which stops once the design is built
+and hands it over instead of writing it. Messages that lhc would print are
+collected, and the last one becomes the error message of a failed call.
+Exceptions never cross the interface; each entry point maps them to a code.
+
+All generators share one thread pool, created on first use.
+
+*******************************************************************************/
+
+#define LHC_NO_MAIN
+#include "main.cpp"
+#include "lhc.h"
+
+// Rows that one task of lhc_generate_into() computes; smaller requests run on the caller.
+constexpr long CAPI_TILE_ROWS = 4 * JITTER_BLOCK_ROWS;
+
+struct lhc_generator {
+    Design design;
+};
+
+namespace {
+
+thread_local std::string lastError;
+
+ThreadPool& libraryPool() {
+    static ThreadPool pool;
+    return pool;
+}
+
+int fail(const int code, const std::string& message) {
+    lastError = message;
+    return code;
+}
+
+// Runs an entry point and turns whatever it throws into an error code.
+template <class Function>
+int guarded(Function function) {
+    try {
+        return function();
+    } catch (const cxxopts::exceptions::exception& e) {
+        return fail(LHC_ERROR_INVALID_ARGUMENT, e.what());
+    } catch (const std::invalid_argument& e) {
+        return fail(LHC_ERROR_INVALID_ARGUMENT, e.what());
+    } catch (const std::out_of_range& e) {
+        return fail(LHC_ERROR_INVALID_ARGUMENT, std::string("Invalid input. Value out of range: ") + e.what());
+    } catch (const std::bad_alloc&) {
+        return fail(LHC_ERROR_OUT_OF_MEMORY, "Out of memory");
+    } catch (const std::system_error& e) {
+        return fail(LHC_ERROR_IO, e.what());
+    } catch (const std::exception& e) {
+        return fail(LHC_ERROR_INTERNAL, e.what());
+    } catch (...) {
+        return fail(LHC_ERROR_INTERNAL, "Unknown error");
+    }
+}
+
+// The last non-empty line of the messages of a job, which holds its error.
+std::string lastLine(const std::string& log) {
+    const size_t end = log.find_last_not_of('\n');
+    if (end == std::string::npos) {
+        return "";
+    }
+    const size_t start = log.rfind('\n', end);
+    return log.substr(start == std::string::npos ? 0 : start + 1, end + 1 - (start == std::string::npos ? 0 : start + 1));
+}
+
+int create(lhc_generator** generator, const std::vector<std::string>& arguments) {
+    if (generator == nullptr) {
+        return fail(LHC_ERROR_INVALID_ARGUMENT, "Invalid input. generator is null.");
+    }
+    *generator = nullptr;
+    std::vector<const char*> argv{"lhc"};
+    for (const std::string& argument : arguments) {
+        argv.push_back(argument.c_str());
+    }
+
+    auto created = std::make_unique<lhc_generator>();
+    std::ostringstream log;
+    const int status = runJob(argv.size(), argv.data(), libraryPool(), &log, nullptr, &created->design);
+    if (status != 0 || created->design.rows() == 0) {
+        // --help also ends here, with the help text as the message
+        return fail(LHC_ERROR_INVALID_ARGUMENT, status != 0 ? lastLine(log.str()) : log.str());
+    }
+    *generator = created.release();
+    return LHC_OK;
+}
+
+} // namespace
+
+extern "C" {
+
+int lhc_abi_version(void) {
+    return LHC_ABI_VERSION;
+}
+
+int lhc_create(lhc_generator** generator, int argc, const char* const* argv) {
+    return guarded([&]() {
+        if (argc < 0 || (argc > 0 && argv == nullptr)) {
+            return fail(LHC_ERROR_INVALID_ARGUMENT, "Invalid input. argv is null.");
+        }
+        return create(generator, std::vector<std::string>(argv, argv + argc));
+    });
+}
+
+int lhc_create_from_string(lhc_generator** generator, const char* arguments) {
+    return guarded([&]() {
+        if (arguments == nullptr) {
+            return fail(LHC_ERROR_INVALID_ARGUMENT, "Invalid input. arguments is null.");
+        }
+        return create(generator, splitArguments(arguments));
+    });
+}
+
+int64_t lhc_rows(const lhc_generator* generator) {
+    return generator == nullptr ? -1 : generator->design.rows();
+}
+
+int lhc_dimensions(const lhc_generator* generator) {
+    return generator == nullptr ? -1 : generator->design.dimensions();
+}
+
+int lhc_generate_into(const lhc_generator* generator, double* buffer, size_t ld, int64_t first_row, int64_t rows, int layout) {
+    return guarded([&]() {
+        if (generator == nullptr || (buffer == nullptr && rows > 0)) {
+            return fail(LHC_ERROR_INVALID_ARGUMENT, "Invalid input. generator or buffer is null.");
+        }
+        if (layout != LHC_ROW_MAJOR && layout != LHC_COLUMN_MAJOR) {
+            return fail(LHC_ERROR_INVALID_ARGUMENT, "Invalid input. Unknown layout " + std::to_string(layout) + ".");
+        }
+        const Design& design = generator->design;
+        if (first_row < 0 || rows < 0 || first_row > design.rows() - rows) {
+            return fail(LHC_ERROR_OUT_OF_RANGE, "Rows " + std::to_string(first_row) + " to " + std::to_string(first_row + rows) + " are outside the design of " + std::to_string(design.rows()) + " rows.");
+        }
+        const bool rowMajor = layout == LHC_ROW_MAJOR;
+        if (ld < (rowMajor ? (size_t)design.dimensions() : (size_t)rows)) {
+            return fail(LHC_ERROR_OUT_OF_RANGE, "The leading dimension " + std::to_string(ld) + " is smaller than the " + (rowMajor ? "number of dimensions." : "number of rows."));
+        }
+
+        const size_t rowStride = rowMajor ? ld : 1;
+        const size_t columnStride = rowMajor ? 1 : ld;
+        auto fill = [&](const long start, const long end) {
+            designValues(design, first_row + start, first_row + end, buffer + start * rowStride, rowStride, columnStride);
+        };
+        if (rows <= CAPI_TILE_ROWS) {
+            fill(0, rows);
+        } else {
+            libraryPool().forEach((rows + CAPI_TILE_ROWS - 1) / CAPI_TILE_ROWS, [&](const long tile) {
+                fill(tile * CAPI_TILE_ROWS, std::min<long>(rows, (tile + 1) * CAPI_TILE_ROWS));
+            });
+        }
+        return LHC_OK;
+    });
+}
+
+void lhc_destroy(lhc_generator* generator) {
+    delete generator;
+}
+
+const char* lhc_last_error(void) {
+    return lastError.c_str();
+}
+
+}
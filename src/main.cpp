@@ -27,8 +27,29 @@ Added ability to toggle verbose console logging.
 #include <regex>
 #include <functional>
 #include <fstream>
+#include <sstream>
 #include <random>
 #include <chrono>
+#include <charconv>
+#include <array>
+#include <mutex>
+#include <sys/stat.h>
+#include "orthogonal_array.hpp"
+#include "parallel.hpp"
+#include "sliced.hpp"
+#include "design_reader.hpp"
+#include "augment.hpp"
+#include "numa.hpp"
+#include "plan.hpp"
+#include "server.hpp"
+#include "ring.hpp"
+#include "cache.hpp"
+#include "progress.hpp"
+#include "candidates.hpp"
+#include "distributions.hpp"
+#include "output.hpp"
+#include "design.hpp"
+#include "verify.hpp"
 
 std::vector<std::string> split(const std::string& str, const std::string& delimiter) {
     std::vector<std::string> tokens;
@@ -55,21 +76,40 @@ std::pair<double, double> parseBounds(const std::string& input) {
     return {std::stof(bounds[0]), std::stof(bounds[1])};
 }
 
-std::vector<std::tuple<int, double, double>> parseOverrides(const std::string& input) {
-    std::vector<std::tuple<int, double, double>> result;
+struct ScaleOverride {
+    int dimension;
+    double low;
+    double high;
+    Marginal marginal; // uniform unless a distribution name follows the dimension index
+};
+
+std::vector<ScaleOverride> parseOverrides(const std::string& input) {
+    std::vector<ScaleOverride> result;
     if (input.empty()) 
         return result;
 
     auto entries = split(input, ",");
     for (const auto& entry : entries) {
         auto parts = split(entry, ":");
-        if (parts.size() != 3) 
-            throw std::invalid_argument("Invalid scale override format, use dim:lower:upper");
+        if (parts.size() < 3) 
+            throw std::invalid_argument("Invalid scale override format, use dim:lower:upper or dim:distribution:parameters");
             
         int dim = std::stoi(parts[0]);
+        if (std::isalpha(parts[1][0])) {
+            Marginal marginal = makeMarginal(parts[1], std::vector<std::string>(parts.begin() + 2, parts.end()));
+            if (marginal.isUniform()) {
+                result.push_back({dim, marginal.parameters[0], marginal.parameters[1], Marginal()});
+            } else {
+                result.push_back({dim, 0, 1, marginal});
+            }
+            continue;
+        }
+
+        if (parts.size() != 3) 
+            throw std::invalid_argument("Invalid scale override format, use dim:lower:upper");
         double low = std::stof(parts[1]);
         double high = std::stof(parts[2]);
-        result.emplace_back(dim, low, high);
+        result.push_back({dim, low, high, Marginal()});
     }
 
     return result;
@@ -158,6 +198,13 @@ bool randomIsValid(const std::vector<std::string> random, const int NUMBER_OF_DI
     return true;
 }
 
+// Whether two paths name the same existing file, however they are spelled.
+bool isSameFile(const std::string& first, const std::string& second) {
+    struct stat firstStatus, secondStatus;
+    return ::stat(first.c_str(), &firstStatus) == 0 && ::stat(second.c_str(), &secondStatus) == 0
+        && firstStatus.st_dev == secondStatus.st_dev && firstStatus.st_ino == secondStatus.st_ino;
+}
+
 bool outfileIsValid(const std::string outDir) {
     // input validation that the file path is not empty
     if (outDir.length() == 0) {
@@ -195,19 +242,15 @@ bool headingsAreValid(const std::vector<std::string> headings, const int NUMBER_
     return true;
 }
 
-int findPrecision(const double ratio) {
-    int precision = 0;
-
-    while (ratio * pow(10.0, precision) < 100.0) {
-        precision++;
-    }
-
-    return precision;
-}
+int runBatch(const std::string& path, ThreadPool& pool);
 
-int main(int argc, char *argv[])
+// Runs one invocation of lhc. Batch, served and library jobs pass batchLog, which then
+// receives every message instead of the console. Served jobs also pass the sink that
+// receives the design; library jobs pass built, which receives the design instead of
+// writing it anywhere.
+int runJob(int argc, const char* const argv[], ThreadPool& pool, std::ostream* batchLog, std::unique_ptr<OutputSink> served = nullptr, Design* built = nullptr)
 {
-    // letters used: hndrbsoc
+    // letters used: hndrbsocma
     const std::string OPTION_NUMBER = "number";
     const std::string OPTION_DIMENSIONS = "dimensions";
     const std::string OPTION_RANDOM = "random";
@@ -215,12 +258,42 @@ int main(int argc, char *argv[])
     const std::string OPTION_SCALES = "scales";
     const std::string OPTION_OUT_PATH = "out-path";
     const std::string OPTION_HEADINGS = "column-headings";
+    const std::string OPTION_METHOD = "method";
+    const std::string OPTION_STRENGTH = "strength";
+    const std::string OPTION_SLICES = "slices";
+    const std::string OPTION_AUGMENT = "augment";
+    const std::string OPTION_CANDIDATES = "candidates";
+    const std::string OPTION_COMPRESS = "compress";
+    const std::string OPTION_OUT_SHARDS = "out-shards";
+    const std::string OPTION_SEED = "seed";
+    const std::string OPTION_BATCH = "batch";
+    const std::string OPTION_NUMA = "numa";
+    const std::string OPTION_MAX_MEMORY = "max-memory";
+    const std::string OPTION_DRY_RUN = "dry-run";
+    const std::string OPTION_FORMAT = "format";
+    const std::string OPTION_RING_SLOTS = "ring-slots";
+    const std::string OPTION_CACHE_DIR = "cache-dir";
+    const std::string OPTION_CACHE_SIZE = "cache-size";
+    const std::string OPTION_PROGRESS = "progress";
+    const std::string OPTION_PROGRESS_FORMAT = "progress-format";
 
     const std::string RANDOM_TRUE = "true";
     const std::string RANDOM_FALSE = "false";
     const std::string OUT_PATH_DEFAULT = "lhc.csv";
+    const std::string OUT_PATH_STDOUT = "-";
     const std::string BASE_SCALE_DEFAULT = "0:1";
     const std::string RANDOM_DEFAULT = RANDOM_FALSE;
+    const std::string METHOD_RANDOM = "random";
+    const std::string METHOD_OA = "oa";
+    const std::string METHOD_DEFAULT = METHOD_RANDOM;
+    const std::string STRENGTH_DEFAULT = "2";
+    const std::string SLICES_DEFAULT = "1";
+    const std::string CANDIDATES_DEFAULT = "1";
+    const std::string OUT_SHARDS_DEFAULT = "1";
+    const std::string FORMAT_DEFAULT = "csv";
+    const std::string RING_SLOTS_DEFAULT = "8";
+    const std::string CACHE_SIZE_DEFAULT = "1G";
+    const std::string PROGRESS_FORMAT_DEFAULT = "text";
 
     cxxopts::Options options("lhc", "Latin Hypercube generator");
 
@@ -229,28 +302,86 @@ int main(int argc, char *argv[])
         (optionKeyFormatter(OPTION_DIMENSIONS), "Required. Positive integer. The number of dimensions in each point.", cxxopts::value<int>())
         (optionKeyFormatter(OPTION_RANDOM), "Optional. Select randomness: '" + RANDOM_FALSE + "' = none, '" + RANDOM_TRUE + "' = all, or a comma-separated list of dimension indices. This option will add a small amount of random variance to each point in each selected dimension", cxxopts::value<std::string>()->default_value(RANDOM_DEFAULT))
         (optionKeyFormatter(OPTION_BASE_SCALE), "Optional. A pair of floating-point values. Default scale for all dimensions in the form lower:upper", cxxopts::value<std::string>()->default_value(BASE_SCALE_DEFAULT))
-        (optionKeyFormatter(OPTION_SCALES), "Optional. Comma-separated dimension:lower:upper overrides", cxxopts::value<std::string>())
-        (optionKeyFormatter(OPTION_OUT_PATH), "Optional. File path for CSV output", cxxopts::value<std::string>()->default_value(OUT_PATH_DEFAULT))
+        (optionKeyFormatter(OPTION_SCALES), "Optional. Comma-separated dimension:lower:upper overrides, or dimension:distribution:parameters with normal:mean:stddev, lognormal:mu:sigma, loguniform:lower:upper, triangular:lower:mode:upper, beta:alpha:beta[:lower:upper], truncnormal:mean:stddev:lower:upper, empirical:path (a sample file, raw doubles if it ends in .bin), int:lower:upper or cat:a|b|c", cxxopts::value<std::string>())
+        (optionKeyFormatter(OPTION_OUT_PATH), "Optional. File path for CSV output, '" + OUT_PATH_STDOUT + "' to stream it to stdout (messages then go to stderr), or '" + SHM_PATH_PREFIX + "/name' to publish it in a POSIX shared-memory ring for a consumer using lhc_ring.h", cxxopts::value<std::string>()->default_value(OUT_PATH_DEFAULT))
         (optionKeyFormatter(OPTION_HEADINGS), "Optional. Column names for CSV output", cxxopts::value<std::string>())
+        (optionKeyFormatter(OPTION_METHOD), "Optional. Construction method: '" + METHOD_RANDOM + "' = independently shuffled columns, '" + METHOD_OA + "' = orthogonal-array-based design. '" + METHOD_OA + "' requires the number of points to be s^t for a prime power s and at most s+1 dimensions", cxxopts::value<std::string>()->default_value(METHOD_DEFAULT))
+        (OPTION_STRENGTH, "Optional. Positive integer. Strength t of the orthogonal array used by '--" + OPTION_METHOD + " " + METHOD_OA + "'", cxxopts::value<int>()->default_value(STRENGTH_DEFAULT))
+        (OPTION_SLICES, "Optional. Positive integer. Split the design into this many slices that are each a Latin hypercube on their own and together form one. Each slice is written to its own numbered file next to the output path", cxxopts::value<long>()->default_value(SLICES_DEFAULT))
+        (optionKeyFormatter(OPTION_AUGMENT), "Optional. Path to an existing CSV design. Generates --" + OPTION_NUMBER + " additional points that keep the combined design as close to Latin as possible, and writes only the new points, to a file other than the existing design. --" + OPTION_DIMENSIONS + " defaults to the number of columns in the file", cxxopts::value<std::string>())
+        (OPTION_CANDIDATES, "Optional. Positive integer. Generate this many candidate designs one after another and keep the one with the smallest maximum absolute correlation between columns", cxxopts::value<long>()->default_value(CANDIDATES_DEFAULT))
+        (OPTION_COMPRESS, "Optional. Compress the CSV output with 'gzip' or 'zstd' in parallel blocks, or 'none'. Defaults to the output path extension (.gz or .zst)", cxxopts::value<std::string>())
+        (OPTION_OUT_SHARDS, "Optional. Positive integer. Split the rows into this many contiguous ranges written concurrently to numbered files next to the output path, each with its own headings, plus a manifest of row ranges and CRC-32 checksums", cxxopts::value<long>()->default_value(OUT_SHARDS_DEFAULT))
+        (OPTION_SEED, "Optional. Non-negative integer. Seed for the random number generator; the same seed and options give the same design on any number of threads. Defaults to the current time", cxxopts::value<unsigned int>())
+        (OPTION_BATCH, "Optional. Path to a job file with one set of lhc arguments per line. Runs all jobs in this process, several at a time, sharing one thread pool. Blank lines and lines starting with # are skipped", cxxopts::value<std::string>())
+        (OPTION_NUMA, "Optional. NUMA placement for the whole process: 'off', 'interleave' = spread memory over all nodes, or 'first-touch' = pin the workers to nodes and allocate each block of the design on the node that formats it. Defaults to off", cxxopts::value<std::string>())
+        (OPTION_MAX_MEMORY, "Optional. Memory budget such as 512M or 4G. Designs whose strata do not fit are computed on the fly from random-access permutations instead of being stored, which gives a different, equally valid design for the same seed. The choice does not depend on the number of cores", cxxopts::value<std::string>())
+        (OPTION_FORMAT, "Optional. Output format: 'csv', or 'binary' = raw native doubles row by row without headings, as read by lhc verify from .bin files", cxxopts::value<std::string>()->default_value(FORMAT_DEFAULT))
+        (OPTION_RING_SLOTS, "Optional. Positive integer. Number of blocks of about " + std::to_string(2 * OUTPUT_BLOCK_SIZE >> 20) + " MiB in a shared-memory ring; the generator waits when the consumer is this many blocks behind", cxxopts::value<long>()->default_value(RING_SLOTS_DEFAULT))
+        (OPTION_CACHE_DIR, "Optional. Directory of a cache of designs. With --" + OPTION_SEED + ", a design whose strata were built before with the same method, size, seed and options is read from the cache instead of being built again; bounds, distributions and output options may differ", cxxopts::value<std::string>())
+        (OPTION_CACHE_SIZE, "Optional. Size limit of the cache directory such as 512M or 4G; the least recently used designs are removed beyond it", cxxopts::value<std::string>()->default_value(CACHE_SIZE_DEFAULT))
+        (OPTION_PROGRESS, "Optional. Positive number of seconds. Report the completed share, rate and estimated remaining time of the current phase to stderr at this interval", cxxopts::value<double>())
+        (OPTION_PROGRESS_FORMAT, "Optional. Format of progress reports: 'text', or 'json' = one JSON object per line with phase, unit, done, total, percent, elapsed, rate, bytes and eta", cxxopts::value<std::string>()->default_value(PROGRESS_FORMAT_DEFAULT))
+        (OPTION_DRY_RUN, "Optional. Print the plan with its estimated peak memory, time and output size, and stop without generating or writing anything")
         ("h,help", "Print help");
 
     auto result = options.parse(argc, argv);
 
     if (result.count("help")) {
-        std::cout << options.help() << std::endl;
-        std::cout << "NOTE: Please be aware that generating a large number of points (i.e. over five million) may take a long time and be resource intensive." << std::endl;
+        std::ostream& help = batchLog != nullptr ? *batchLog : std::cout;
+        help << options.help() << std::endl;
+        help << "NOTE: Large designs may take a long time and a lot of memory. Use --" + OPTION_DRY_RUN + " to see the estimates for a design, and --" + OPTION_MAX_MEMORY + " to bound its memory." << std::endl;
         return 0;
     }
 
-    if (result.count(OPTION_NUMBER) == 0 || result.count(OPTION_DIMENSIONS) == 0) {
+    // the placement belongs to the shared pool, so batch jobs take it from the command line
+    if (result.count(OPTION_NUMA)) {
+        if (batchLog != nullptr) {
+            throw std::invalid_argument("Invalid input. Batch, served and library jobs cannot change the NUMA policy; pass --" + OPTION_NUMA + " with --" + OPTION_BATCH + " or lhc serve.");
+            return 1;
+        }
+        applyNumaPolicy(parseNumaPolicy(result[OPTION_NUMA].as<std::string>()), pool);
+    }
+
+    if (result.count(OPTION_BATCH)) {
+        if (batchLog != nullptr) {
+            throw std::invalid_argument("Invalid input. Batch, served and library jobs cannot start other batches.");
+            return 1;
+        }
+        return runBatch(result[OPTION_BATCH].as<std::string>(), pool);
+    }
+
+    if (result.count(OPTION_NUMBER) == 0 || (result.count(OPTION_DIMENSIONS) == 0 && result.count(OPTION_AUGMENT) == 0)) {
         throw std::invalid_argument("Missing required arguments");
         return 1;
     }
 
+    // the existing design is read before the output path is validated, which truncates it
+    ExistingDesign existing;
+    if (result.count(OPTION_AUGMENT)) {
+        existing = readDesign(result[OPTION_AUGMENT].as<std::string>());
+        if (existing.rows == 0) {
+            throw std::invalid_argument("Invalid input. Design to augment has no points.");
+            return 1;
+        }
+    }
+
     long NUMBER_OF_POINTS = result[OPTION_NUMBER].as<long>();
-    int NUMBER_OF_DIMENSIONS = result[OPTION_DIMENSIONS].as<int>();
+    int NUMBER_OF_DIMENSIONS = result.count(OPTION_DIMENSIONS) ? result[OPTION_DIMENSIONS].as<int>() : existing.columns.size();
     std::vector<std::string> random = split(result[OPTION_RANDOM].as<std::string>(), ",");
     std::pair<double, double> baseScale = parseBounds(result[OPTION_BASE_SCALE].as<std::string>());
+    std::string method = result[OPTION_METHOD].as<std::string>();
+    int strength = result[OPTION_STRENGTH].as<int>();
+    long slices = result[OPTION_SLICES].as<long>();
+    long candidates = result[OPTION_CANDIDATES].as<long>();
+    long shards = result[OPTION_OUT_SHARDS].as<long>();
+    const uint64_t maxMemory = result.count(OPTION_MAX_MEMORY) ? parseByteSize(result[OPTION_MAX_MEMORY].as<std::string>()) : 0;
+    const bool dryRun = result.count(OPTION_DRY_RUN) > 0;
+    const DesignFormat format = parseDesignFormat(result[OPTION_FORMAT].as<std::string>());
+    const long ringSlots = result[OPTION_RING_SLOTS].as<long>();
+    const uint64_t cacheSize = parseByteSize(result[OPTION_CACHE_SIZE].as<std::string>());
+    const double progressInterval = result.count(OPTION_PROGRESS) ? result[OPTION_PROGRESS].as<double>() : 0;
+    const ProgressFormat progressFormat = parseProgressFormat(result[OPTION_PROGRESS_FORMAT].as<std::string>());
 
     if (NUMBER_OF_POINTS <= 0) {
         throw std::invalid_argument("Number of points must be greater than 0");
@@ -272,9 +403,73 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    double ratio[NUMBER_OF_DIMENSIONS];              // holds the scale of each dimension
-    int precision[NUMBER_OF_DIMENSIONS];             // holds the precision of each dimension
-    double dimensionScales[NUMBER_OF_DIMENSIONS][2]; // holds the lower and upper bounds of each dimension
+    if (method != METHOD_RANDOM && method != METHOD_OA) {
+        throw std::invalid_argument("Invalid input. Unknown method: " + method);
+        return 1;
+    }
+
+    if (slices <= 0 || NUMBER_OF_POINTS % slices != 0) {
+        throw std::invalid_argument("Invalid input. Number of slices must be a positive divisor of the number of points.");
+        return 1;
+    }
+
+    if (slices > 1 && method != METHOD_RANDOM) {
+        throw std::invalid_argument("Invalid input. Slices are only supported with method '" + METHOD_RANDOM + "'.");
+        return 1;
+    }
+
+    if (shards <= 0 || shards > NUMBER_OF_POINTS) {
+        throw std::invalid_argument("Invalid input. Number of output shards must be between 1 and the number of points.");
+        return 1;
+    }
+    if (ringSlots <= 0 || ringSlots > (1L << 20)) {
+        throw std::invalid_argument("Invalid input. Number of ring slots must be between 1 and 1048576.");
+        return 1;
+    }
+
+    if (result.count(OPTION_PROGRESS) && !(progressInterval > 0 && progressInterval <= 86400)) {
+        throw std::invalid_argument("Invalid input. Progress interval must be between 0 and 86400 seconds.");
+        return 1;
+    }
+    if (result.count(OPTION_PROGRESS) && batchLog != nullptr) {
+        throw std::invalid_argument("Invalid input. Batch, served and library jobs cannot report progress.");
+        return 1;
+    }
+
+    if (shards > 1 && slices > 1) {
+        throw std::invalid_argument("Invalid input. Output shards cannot be combined with slices.");
+        return 1;
+    }
+
+    if (candidates <= 0) {
+        throw std::invalid_argument("Invalid input. Number of candidates must be greater than 0.");
+        return 1;
+    }
+
+    if (candidates > 1 && slices > 1) {
+        throw std::invalid_argument("Invalid input. Candidates cannot be combined with slices.");
+        return 1;
+    }
+
+    if (existing.rows > 0) {
+        if ((int)existing.columns.size() != NUMBER_OF_DIMENSIONS) {
+            throw std::invalid_argument("Invalid input. Design to augment has " + std::to_string(existing.columns.size()) + " dimensions, expected " + std::to_string(NUMBER_OF_DIMENSIONS));
+            return 1;
+        }
+        if (method != METHOD_RANDOM || slices > 1 || candidates > 1) {
+            throw std::invalid_argument("Invalid input. Augmenting is only supported with method '" + METHOD_RANDOM + "', no slices and no candidates.");
+            return 1;
+        }
+        if (NUMBER_OF_POINTS + existing.rows > (long)std::mt19937::max()) {
+            throw std::invalid_argument("Number of points must be less than " + std::to_string(std::mt19937::max()));
+            return 1;
+        }
+    }
+
+    std::vector<double> ratio(NUMBER_OF_DIMENSIONS);                       // holds the scale of each dimension
+    std::vector<int> precision(NUMBER_OF_DIMENSIONS);                      // holds the precision of each dimension
+    std::vector<std::array<double, 2>> dimensionScales(NUMBER_OF_DIMENSIONS); // holds the lower and upper bounds of each dimension
+    std::vector<Marginal> marginals(NUMBER_OF_DIMENSIONS);                 // holds the distribution of each dimension
     bool valid;                                      // keeps track of do-while validity
 
     // check if random is valid
@@ -284,11 +479,53 @@ int main(int argc, char *argv[])
 
     // check if outDir is valid
     std::string outDir = result[OPTION_OUT_PATH].as<std::string>();
-    if (!outfileIsValid(outDir)) {
+    Compression compression = parseCompression(result.count(OPTION_COMPRESS) ? result[OPTION_COMPRESS].as<std::string>() : "", outDir);
+    const bool toStdout = outDir == OUT_PATH_STDOUT;
+    const bool toShm = isShmPath(outDir);
+    const std::string ringName = toShm ? shmName(outDir) : "";
+    if (toStdout && (slices > 1 || shards > 1)) {
+        throw std::invalid_argument("Invalid input. Slices and output shards cannot be written to stdout.");
+        return 1;
+    }
+    if (toShm && (slices > 1 || shards > 1)) {
+        throw std::invalid_argument("Invalid input. Slices and output shards cannot be written to shared memory.");
+        return 1;
+    }
+    if (toStdout && batchLog != nullptr) {
+        throw std::invalid_argument("Invalid input. Batch, served and library jobs cannot write to stdout.");
+        return 1;
+    }
+    if (served && (result.count(OPTION_OUT_PATH) || slices > 1 || shards > 1)) {
+        throw std::invalid_argument("Invalid input. Served designs are returned to the client, so they take no output path, slices or shards.");
+        return 1;
+    }
+    if (built && (result.count(OPTION_OUT_PATH) || result.count(OPTION_COMPRESS) || result.count(OPTION_FORMAT) || slices > 1 || shards > 1 || dryRun)) {
+        throw std::invalid_argument("Invalid input. Library designs are written into the caller's buffer, so they take no output path, compression, format, slices, shards or dry run.");
         return 1;
     }
+    // a dry run leaves existing files alone
+    const long outputFiles = std::max(slices, shards);
+    const bool toFiles = !toStdout && !toShm && !dryRun && !served && !built;
+    // the design to augment has been read, but writing truncates the output before use
+    for (long file = 0; result.count(OPTION_AUGMENT) && toFiles && file < outputFiles; file++) {
+        const std::string path = outputFiles == 1 ? outDir : shardPath(outDir, file, outputFiles);
+        if (isSameFile(path, result[OPTION_AUGMENT].as<std::string>())) {
+            throw std::invalid_argument("Invalid input. Output path " + path + " is the design to augment, which writing would overwrite.");
+            return 1;
+        }
+    }
+    if (outputFiles == 1 && toFiles && !outfileIsValid(outDir)) {
+        return 1;
+    }
+    for (long file = 0; outputFiles > 1 && toFiles && file < outputFiles; file++) {
+        if (!outfileIsValid(shardPath(outDir, file, outputFiles))) {
+            return 1;
+        }
+    }
     std::ofstream out;
-    out.open(outDir, std::ios::out | std::ios::trunc);
+    if (outputFiles == 1 && toFiles) {
+        out.open(outDir, std::ios::out | std::ios::trunc | std::ios::binary);
+    }
 
     // check if headings are valid
     std::vector<std::string> headings;
@@ -299,6 +536,8 @@ int main(int argc, char *argv[])
                 ","
             )
         );
+    } else if (!existing.headings.empty()) {
+        headings = existing.headings;
     } else {
         for (int dimensionIndex = 0; dimensionIndex < NUMBER_OF_DIMENSIONS; ++dimensionIndex) {
             headings.push_back("dim" + std::to_string(dimensionIndex));
@@ -315,27 +554,58 @@ int main(int argc, char *argv[])
         dimensionScales[dimensionIndex][1] = baseScale.second;
     }
 
-    std::cout << "Generating " << NUMBER_OF_POINTS << " points in " << NUMBER_OF_DIMENSIONS << " dimensions.\n";
+    // when the design goes to stdout, keep it clean of messages
+    std::ostream& console = batchLog != nullptr ? *batchLog : toStdout ? std::cerr : std::cout;
+    std::ostream& errors = batchLog != nullptr ? *batchLog : std::cerr;
+
+    console << "Generating " << NUMBER_OF_POINTS << " points in " << NUMBER_OF_DIMENSIONS << " dimensions.\n";
 
-    std::cout << "Random selection: ";
+    console << "Random selection: ";
     for (int i = 0; i < random.size(); i++){
-        std::cout << random[i] << " ";
+        console << random[i] << " ";
     }
-    std::cout << "\n";
+    console << "\n";
 
-    std::cout << "File output path: " << outDir << "\n";
+    console << "File output path: " << outDir << "\n";
 
-    std::cout << "Headings: ";
+    console << "Headings: ";
     for (const std::string h : headings) {
-        std::cout << h << " ";
+        console << h << " ";
+    }
+    console << "\n";
+
+    console << "Method: " << method;
+    if (method == METHOD_OA) {
+        console << " (strength " << strength << ")";
+    }
+    console << "\n";
+
+    if (candidates > 1) {
+        console << "Candidates: " << candidates << "\n";
+    }
+
+    if (existing.rows > 0) {
+        console << "Augmenting " << existing.rows << " existing points from " << result[OPTION_AUGMENT].as<std::string>() << "\n";
+    }
+
+    if (slices > 1) {
+        console << "Slices: " << slices << " of " << NUMBER_OF_POINTS / slices << " points\n";
     }
-    std::cout << "\n";
 
-    std::cout << "Base scale: " << baseScale.first << ":" << baseScale.second << "\n";
+    const unsigned int randomSeed = result.count(OPTION_SEED)
+        ? result[OPTION_SEED].as<unsigned int>()
+        : static_cast<unsigned int>(std::chrono::high_resolution_clock::now().time_since_epoch().count());
+    console << "Seed: " << randomSeed << "\n";
+
+    if (numaPolicy() != NumaPolicy::Off) {
+        console << "NUMA: " << (numaPolicy() == NumaPolicy::Interleave ? "interleave" : "first-touch") << " on " << numaNodes().size() << " node(s)\n";
+    }
+
+    console << "Base scale: " << baseScale.first << ":" << baseScale.second << "\n";
 
     // set the lower and upper bounds for each customized dimension
     if (result.count(OPTION_SCALES)) {
-        for (const auto& [dimensionIndex, low, high] : parseOverrides(result[OPTION_SCALES].as<std::string>())) {
+        for (const auto& [dimensionIndex, low, high, marginal] : parseOverrides(result[OPTION_SCALES].as<std::string>())) {
             // input validation that the dimension index is valid
             if (dimensionIndex < 0 || dimensionIndex >= NUMBER_OF_DIMENSIONS) {
                 throw std::invalid_argument("Invalid dimension index in --scale: " + std::to_string(dimensionIndex));
@@ -348,88 +618,687 @@ int main(int argc, char *argv[])
                 return 1;
             }
 
-            // set the lower and upper bounds
+            // input validation that augmented dimensions can be mapped back to strata
+            if (!marginal.isUniform() && existing.rows > 0) {
+                throw std::invalid_argument("Invalid input. Augmenting is only supported for uniform dimensions.");
+                return 1;
+            }
+
+            // set the lower and upper bounds; other distributions are stratified on 0:1 first
             dimensionScales[dimensionIndex][0] = low;
             dimensionScales[dimensionIndex][1] = high;
+            marginals[dimensionIndex] = marginal;
 
-            std::cout << "Dimension " << dimensionIndex << " scale: " << low << ":" << high << "\n";
+            if (marginal.isUniform()) {
+                console << "Dimension " << dimensionIndex << " scale: " << low << ":" << high << "\n";
+            } else {
+                console << "Dimension " << dimensionIndex << " distribution: " << describeMarginal(marginal) << "\n";
+            }
         }
     }
 
-    std::vector<std::vector<double>> points(NUMBER_OF_POINTS, std::vector<double>(NUMBER_OF_DIMENSIONS));   //stores coordinates
-    
-    std::seed_seq seed{ static_cast<unsigned int>(std::chrono::high_resolution_clock::now().time_since_epoch().count()) };  // seeds random generator
+    // set the scale and precision of each dimension, and whether it gets random variance;
+    // an augmented design is stratified on the finer grid of existing and new points together
+    const long strataCount = NUMBER_OF_POINTS + existing.rows;
+    std::vector<bool> jittered(NUMBER_OF_DIMENSIONS);
+    for (int dimensionIndex = 0; dimensionIndex < NUMBER_OF_DIMENSIONS; dimensionIndex++) {
+        ratio[dimensionIndex] = (dimensionScales[dimensionIndex][1] - dimensionScales[dimensionIndex][0]) / strataCount;
+        precision[dimensionIndex] = marginals[dimensionIndex].isDiscrete() ? 0 : findPrecision(
+            marginals[dimensionIndex].isUniform()
+                ? ratio[dimensionIndex]
+                : marginalResolution(marginals[dimensionIndex], strataCount)
+        );
+        jittered[dimensionIndex] = !(
+            (
+                random.size() > 1
+                && !vectorContains(random, std::to_string(dimensionIndex))
+            ) 
+            || random[0] == RANDOM_FALSE
+        );
+    }
+
+    std::seed_seq seed{ randomSeed };  // seeds random generator
     std::mt19937 generator (seed);  // create random number generator
 
-    std::cout << "Generating points...\n";
+    // everything but the strata is shared by the whole design and by every slice
+    Design design;
+    design.ratio = ratio;
+    design.jittered = jittered;
+    design.marginals = marginals;
+    design.precision = precision;
+    for (const std::array<double, 2>& scale : dimensionScales) {
+        design.lower.push_back(scale[0]);
+    }
+
+    // estimate the memory and pick where the strata live
+    Workload workload;
+    workload.rows = NUMBER_OF_POINTS;
+    workload.dimensions = NUMBER_OF_DIMENSIONS;
+    workload.rowBytes = format == DesignFormat::Binary ? NUMBER_OF_DIMENSIONS * sizeof(double) : estimatedRowBytes(design, strataCount);
+    workload.headingBytes = 0;
+    for (size_t headingIndex = 0; format == DesignFormat::Csv && headingIndex < headings.size(); headingIndex++) {
+        workload.headingBytes += headings[headingIndex].size() + 1;
+    }
+    workload.strataCopies = 1;
+    workload.strataBuilds = candidates;
+    workload.inputBytes = 0;
+    if (slices > 1) {
+        workload.strataCopies = 1 + (double)std::min<long>(slices, pool.size() + 1) / slices; // dealt strata and the slices being written
+    } else if (candidates > 1) {
+        workload.strataCopies = 2 + (method == METHOD_OA ? 3.0 / NUMBER_OF_DIMENSIONS : 0); // the candidate being scored and the best so far
+    } else if (method == METHOD_OA) {
+        workload.strataCopies = 1 + 3.0 / NUMBER_OF_DIMENSIONS; // row order and working columns
+    } else if (existing.rows > 0) {
+        workload.inputBytes = (uint64_t)existing.rows * NUMBER_OF_DIMENSIONS * sizeof(double) + (uint64_t)strataCount * sizeof(long);
+    }
+    workload.files = outputFiles;
+    const size_t ringRowBytes = format == DesignFormat::Binary ? NUMBER_OF_DIMENSIONS * sizeof(double) : rowWidth(design, strataCount);
+    workload.sharedBytes = toShm && !served ? sizeof(lhc_ring_header) + ringSlots * ringSlotBytes(ringRowBytes) : 0;
+    workload.compression = compression;
+    workload.implicitAllowed = method == METHOD_RANDOM && slices == 1 && candidates == 1 && existing.rows == 0;
+    const ExecutionPlan plan = planExecution(workload, pool.size(), maxMemory);
+
+    console << "Plan: " << describeStrategy(plan.strategy) << ", peak memory about " << formatByteSize(plan.peakBytes);
+    if (maxMemory > 0) {
+        console << " of " << formatByteSize(maxMemory);
+    }
+    console << "\n";
+    if (dryRun) {
+        console << "Strata: " << formatByteSize(plan.strataBytes) << ", output buffers: " << formatByteSize(plan.bufferBytes) << " for " << pool.size() << " worker(s)\n";
+        console << "Estimated output size: " << formatByteSize(plan.outputBytes) << "\n";
+        console << "Estimated time: " << plan.seconds << " s\n";
+        console << "Dry run, nothing generated." << std::endl;
+        return 0;
+    }
+
+    // reports go to stderr, so they never mix with a design on stdout
+    std::unique_ptr<Progress> progress;
+    if (progressInterval > 0) {
+        progress = std::make_unique<Progress>(std::cerr, progressInterval, progressFormat);
+    }
+
+    if (slices > 1) {
+        console << "Generating points...\n";
+        if (progress) {
+            progress->phase("rows", NUMBER_OF_POINTS, "rows");
+        }
+        try {
+            std::vector<std::vector<long>> dealt = dealSlices(NUMBER_OF_POINTS, NUMBER_OF_DIMENSIONS, slices, generator);
+
+            // every slice draws from its own generator so that slices can be built concurrently
+            std::vector<unsigned int> sliceSeeds(slices);
+            for (unsigned int& sliceSeed : sliceSeeds) {
+                sliceSeed = generator();
+            }
+
+            std::mutex consoleMutex;
+            pool.forEach(slices, [&](const long slice) {
+                std::seed_seq sliceSeed{ sliceSeeds[slice] };
+                std::mt19937 sliceGenerator (sliceSeed);
+                Design sliceDesign = design;
+                sliceDesign.strata = sliceStrata(dealt, slices, slice, sliceGenerator);
+                sliceDesign.jitterSeed = sliceGenerator();
+
+                // each slice is complete on disk as soon as it is written, independent of the others
+                std::string slicePath = shardPath(outDir, slice, slices);
+                std::ofstream sliceOut(slicePath, std::ios::out | std::ios::trunc | std::ios::binary);
+                writeDesign(*makeSink(std::make_unique<StreamSink>(sliceOut), compression, pool, false), headings, sliceDesign, 0, sliceDesign.rows(), pool, format, progress.get());
+                sliceOut.close();
+
+                std::lock_guard<std::mutex> lock(consoleMutex);
+                console << "Wrote slice " << slice << " to " << slicePath << std::endl;
+            });
+        } catch (std::exception& e) {
+            errors << e.what() << std::endl;
+            return 1;
+        }
+
+        console << "Done!" << std::endl;
+
+        return 0;
+    }
+
+    // the strata depend on these alone; bounds and distributions only change the values,
+    // except that augmenting fits the new points to the existing ones on their scales.
+    // The cache only saves time, so a cache that fails is reported and the run goes on.
+    std::unique_ptr<DesignCache> cache;
+    std::string cacheSpec;
+    if (result.count(OPTION_CACHE_DIR) && !result.count(OPTION_SEED)) {
+        console << "Cache: not used without --" << OPTION_SEED << "\n";
+    } else if (result.count(OPTION_CACHE_DIR) && plan.strategy == ExecutionStrategy::InMemory) {
+        try {
+            cache = std::make_unique<DesignCache>(result[OPTION_CACHE_DIR].as<std::string>(), cacheSize);
+        } catch (std::exception& e) {
+            console << "Cache: not used. " << e.what() << "\n";
+        }
+        std::ostringstream spec;
+        spec << "lhc strata 1\nmethod " << method << "\npoints " << NUMBER_OF_POINTS << "\ndimensions " << NUMBER_OF_DIMENSIONS
+            << "\nseed " << randomSeed << "\ncandidates " << candidates;
+        if (method == METHOD_OA) {
+            spec << "\nstrength " << strength;
+        }
+        if (existing.rows > 0) {
+            uint64_t existingHash = fnv1a(nullptr, 0);
+            for (const std::vector<double>& column : existing.columns) {
+                existingHash = fnv1a(reinterpret_cast<const char*>(column.data()), column.size() * sizeof(double), existingHash);
+            }
+            spec << "\naugment " << existing.rows << " " << std::hex << existingHash << std::dec << std::hexfloat;
+            for (const std::array<double, 2>& scale : dimensionScales) {
+                spec << " " << scale[0] << ":" << scale[1];
+            }
+        }
+        cacheSpec = spec.str();
+    }
+
+    console << "Generating points...\n";
     try {
-        // for loop populates points array
-        for(long dimensionIndex = 0; dimensionIndex < NUMBER_OF_DIMENSIONS; dimensionIndex++){
-            // the range of values 0 to SIZE 
-            std::vector<long> range(NUMBER_OF_POINTS);
-            
-            // for loop populates range array
-            for(long rangeIndex = 0; rangeIndex < NUMBER_OF_POINTS; rangeIndex++){  
-                range[rangeIndex] = rangeIndex;
+        // only the strata are generated up front; values are computed block by block as they are written
+        bool cached = false;
+        if (cache) {
+            try {
+                cached = cache->load(cacheSpec, design, pool);
+            } catch (std::exception& e) {
+                console << "Cache: not read. " << e.what() << "\n";
             }
-            
-            double upperBound = dimensionScales[dimensionIndex][1];
-            double lowerBound = dimensionScales[dimensionIndex][0];
-            ratio[dimensionIndex] = (upperBound - lowerBound) / NUMBER_OF_POINTS;
-            precision[dimensionIndex] = findPrecision(ratio[dimensionIndex]);
-            
-            // for loop generates random unique selection from range
-            for(long pointIndex = 0; pointIndex < NUMBER_OF_POINTS; pointIndex++){  
-                // temporary var to generate random index in range
-                long temp = generator() % NUMBER_OF_POINTS;   
-                double decimal = (double)(generator() % 100) / 100.0; //holds random addition to value
-                
-                if (
-                    (
-                        random.size() > 1
-                        && !vectorContains(random, std::to_string(dimensionIndex))
-                    ) 
-                    || random[0] == RANDOM_FALSE
-                ) {
-                    decimal = 0;
+        }
+        if (cached) {
+            console << "Cache: read strata from " << cache->path(cacheSpec) << "\n";
+        } else if (candidates > 1) {
+            double bestScore = 0;
+            if (progress) {
+                progress->phase("candidates", candidates * NUMBER_OF_POINTS * NUMBER_OF_DIMENSIONS, "values");
+            }
+            design.strata = bestOfCandidates(candidates, [&](std::mt19937& candidateGenerator) {
+                if (method == METHOD_OA) {
+                    return orthogonalArrayStrata(NUMBER_OF_POINTS, NUMBER_OF_DIMENSIONS, strength, candidateGenerator, progress.get());
                 }
-                
-                // while loop ensures unique selection
-                while(range[temp] == -1){   
-                    temp = generator() % NUMBER_OF_POINTS;
+                return randomStrata(NUMBER_OF_POINTS, NUMBER_OF_DIMENSIONS, candidateGenerator, pool, {}, progress.get());
+            }, generator, bestScore, pool);
+            console << "Best candidate maximum absolute correlation: " << bestScore << "\n";
+        } else if (plan.strategy == ExecutionStrategy::Implicit) {
+            design.permutations = randomPermutations(NUMBER_OF_POINTS, NUMBER_OF_DIMENSIONS, generator);
+        } else {
+            if (progress) {
+                progress->phase("strata", NUMBER_OF_POINTS * NUMBER_OF_DIMENSIONS, "values");
+            }
+            if (method == METHOD_OA) {
+                design.strata = orthogonalArrayStrata(NUMBER_OF_POINTS, NUMBER_OF_DIMENSIONS, strength, generator, progress.get());
+            } else if (existing.rows > 0) {
+                design.strata = augmentStrata(existing.columns, dimensionScales, NUMBER_OF_POINTS, generator, progress.get());
+            } else {
+                design.strata = randomStrata(NUMBER_OF_POINTS, NUMBER_OF_DIMENSIONS, generator, pool, allocateStrata(design, NUMBER_OF_POINTS, pool), progress.get());
+            }
+        }
+        if (!cached) {
+            design.jitterSeed = generator();
+            try {
+                if (cache && cache->store(cacheSpec, design)) {
+                    console << "Cache: stored strata in " << cache->path(cacheSpec) << "\n";
                 }
-                
-                points[pointIndex][dimensionIndex] = temp + decimal;     // assigns current index of "points" the value of "range[temp]" plus a random decimal value
-                points[pointIndex][dimensionIndex] *= ratio[dimensionIndex];    // adjust value of "points" for range of possible values
-                points[pointIndex][dimensionIndex] += lowerBound;               // adjust value of "points" for starting point of possible values
-                range[temp] = -1;                                               // selected index is marked as selected
+            } catch (std::exception& e) {
+                console << "Cache: not stored. " << e.what() << "\n";
             }
         }
     } catch (std::exception& e) {
-        std::cerr << e.what() << std::endl;
+        errors << e.what() << std::endl;
         return 1;
     }
 
+    if (built) {
+        *built = std::move(design);
+        console << "Done!" << std::endl;
+        return 0;
+    }
+
     // export headings and data to csv
-    std::cout << "Writing to " << result[OPTION_OUT_PATH].as<std::string>() << "..." << std::endl;
-    for (const std::string h : headings) {
-        out << h;
-        if (h != headings.back()) {
-            out << ",";
+    if (progress) {
+        progress->phase("rows", NUMBER_OF_POINTS, "rows");
+    }
+    if (shards > 1) {
+        console << "Writing " << shards << " shards to " << shardPath(outDir, 0, shards) << "..." << std::endl;
+
+        // every shard covers a contiguous row range and is written by its own thread
+        std::vector<long> firstRows(shards + 1);
+        std::vector<uint32_t> checksums(shards);
+        std::vector<uint64_t> sizes(shards);
+        for (long shard = 0; shard <= shards; shard++) {
+            firstRows[shard] = NUMBER_OF_POINTS * shard / shards;
         }
+        try {
+            pool.forEach(shards, [&](const long shard) {
+                std::ofstream shardOut(shardPath(outDir, shard, shards), std::ios::out | std::ios::trunc | std::ios::binary);
+                auto checksum = std::make_unique<ChecksumSink>(std::make_unique<StreamSink>(shardOut));
+                ChecksumSink& totals = *checksum; // owned by the sink chain below
+                std::unique_ptr<OutputSink> sink = makeSink(std::move(checksum), compression, pool, false);
+                writeDesign(*sink, headings, design, firstRows[shard], firstRows[shard + 1], pool, format, progress.get());
+                shardOut.close();
+                checksums[shard] = totals.crc;
+                sizes[shard] = totals.bytes;
+            });
+        } catch (std::exception& e) {
+            errors << e.what() << std::endl;
+            return 1;
+        }
+
+        std::ofstream manifest(manifestPath(outDir), std::ios::out | std::ios::trunc);
+        manifest << "shard,path,first_row,rows,bytes,crc32\n";
+        for (long shard = 0; shard < shards; shard++) {
+            char crc[9];
+            std::snprintf(crc, sizeof(crc), "%08x", checksums[shard]);
+            manifest << shard << "," << shardPath(outDir, shard, shards) << "," << firstRows[shard] << "," << firstRows[shard + 1] - firstRows[shard] << "," << sizes[shard] << "," << crc << "\n";
+        }
+        manifest.close();
+        console << "Wrote manifest to " << manifestPath(outDir) << std::endl;
+
+        console << "Done!" << std::endl;
+
+        return 0;
     }
-    for (long pointIndex = 0; pointIndex < NUMBER_OF_POINTS; pointIndex++) {        
-        out << std::endl;
-        for (int dimensionIndex = 0; dimensionIndex < NUMBER_OF_DIMENSIONS; dimensionIndex++) {
-            out << std::fixed << std::setprecision(precision[dimensionIndex]) << points[pointIndex][dimensionIndex];
-            if (dimensionIndex < NUMBER_OF_DIMENSIONS - 1) {
-                out << ",";
+
+    // a failed write, such as a consumer closing the ring early, fails the job instead of terminating
+    try {
+        // served designs are written to memory, which needs no I/O thread
+        const bool async = !served;
+        std::unique_ptr<OutputSink> destination = std::move(served);
+        if (!destination) {
+            console << "Writing to " << result[OPTION_OUT_PATH].as<std::string>() << "..." << std::endl;
+            if (toShm) {
+                destination = std::make_unique<SharedRingSink>(ringName, ringSlots, format == DesignFormat::Binary, compression != Compression::None, NUMBER_OF_DIMENSIONS, NUMBER_OF_POINTS, ringRowBytes);
+            } else if (toStdout) {
+                destination = std::make_unique<DescriptorSink>(STDOUT_FILENO);
+            } else {
+                destination = std::make_unique<StreamSink>(out);
             }
         }
+        writeDesign(*makeSink(std::move(destination), compression, pool, async), headings, design, 0, NUMBER_OF_POINTS, pool, format, progress.get());
+    } catch (std::exception& e) {
+        errors << e.what() << std::endl;
+        return 1;
     }
     out.close();
 
-    std::cout << "Done!" << std::endl;
+    console << "Done!" << std::endl;
 
     return 0;
 }
+
+// Splits a job line into arguments at whitespace. Single or double quotes group words.
+std::vector<std::string> splitArguments(const std::string& line) {
+    std::vector<std::string> arguments;
+    std::string current;
+    bool inArgument = false;
+    char quote = 0;
+    for (const char character : line) {
+        if (quote != 0) {
+            if (character == quote) {
+                quote = 0;
+            } else {
+                current += character;
+            }
+        } else if (character == '\'' || character == '"') {
+            quote = character;
+            inArgument = true;
+        } else if (std::isspace((unsigned char)character)) {
+            if (inArgument) {
+                arguments.push_back(current);
+                current.clear();
+                inArgument = false;
+            }
+        } else {
+            current += character;
+            inArgument = true;
+        }
+    }
+    if (quote != 0) {
+        throw std::invalid_argument("Invalid input. Unterminated quote in job: " + line);
+    }
+    if (inArgument) {
+        arguments.push_back(current);
+    }
+    return arguments;
+}
+
+// Runs every job of a job file, several at a time as tasks of the shared pool, whose
+// waiting threads only help with the blocks of a job and never start another job. Each
+// job's messages are collected and printed together once it finishes, so concurrent jobs
+// do not interleave their output.
+int runBatch(const std::string& path, ThreadPool& pool) {
+    std::ifstream jobFile(path);
+    if (!jobFile) {
+        throw std::invalid_argument("Invalid input. Cannot open job file: " + path);
+        return 1;
+    }
+    std::vector<std::string> jobs;
+    std::vector<long> lineNumbers;
+    std::string line;
+    for (long lineNumber = 1; std::getline(jobFile, line); lineNumber++) {
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#') {
+            continue;
+        }
+        jobs.push_back(line);
+        lineNumbers.push_back(lineNumber);
+    }
+
+    std::cout << "Running " << jobs.size() << " jobs from " << path << "..." << std::endl;
+    const auto started = std::chrono::steady_clock::now();
+    std::mutex consoleMutex;
+    std::atomic<long> failed{0};
+    pool.forEach(jobs.size(), [&](const long job) {
+        std::ostringstream log;
+        int status = 1;
+        try {
+            std::vector<std::string> arguments = splitArguments(jobs[job]);
+            arguments.insert(arguments.begin(), "lhc");
+            std::vector<const char*> argv;
+            for (const std::string& argument : arguments) {
+                argv.push_back(argument.c_str());
+            }
+            status = runJob(argv.size(), argv.data(), pool, &log);
+        } catch (std::exception& e) {
+            log << e.what() << std::endl;
+        }
+        if (status != 0) {
+            failed++;
+        }
+
+        std::lock_guard<std::mutex> lock(consoleMutex);
+        std::cout << "Job " << job << " (line " << lineNumbers[job] << ")" << (status == 0 ? "" : " failed") << ":\n" << log.str();
+    });
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    std::cout << jobs.size() - failed << " of " << jobs.size() << " jobs succeeded in " << seconds << " s" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
+
+// lhc verify: checks that design files are Latin hypercubes.
+int runVerify(int argc, const char* const argv[])
+{
+    const std::string OPTION_FILES = "files";
+    const std::string OPTION_DIMENSIONS = "dimensions";
+    const std::string OPTION_BASE_SCALE = "base-scale";
+    const std::string OPTION_SCALES = "scales";
+    const std::string OPTION_VIOLATIONS = "violations";
+
+    const std::string BASE_SCALE_DEFAULT = "0:1";
+    const std::string VIOLATIONS_DEFAULT = "10";
+
+    cxxopts::Options options("lhc verify", "Checks that design files have exactly one point in every stratum of every dimension. Several files, such as the shards of one design, are checked as one design.");
+
+    options.add_options()
+        (optionKeyFormatter(OPTION_DIMENSIONS), "Optional. Positive integer. The number of dimensions; required for binary designs (files ending in .bin, raw native doubles row by row). Defaults to the number of columns of a CSV design", cxxopts::value<int>())
+        (optionKeyFormatter(OPTION_BASE_SCALE), "Optional. A pair of floating-point values. Scale of all dimensions in the form lower:upper", cxxopts::value<std::string>()->default_value(BASE_SCALE_DEFAULT))
+        (optionKeyFormatter(OPTION_SCALES), "Optional. Comma-separated dimension:lower:upper overrides, as for generation", cxxopts::value<std::string>())
+        (OPTION_VIOLATIONS, "Optional. Positive integer. The number of violations to list", cxxopts::value<long>()->default_value(VIOLATIONS_DEFAULT))
+        (OPTION_FILES, "Design files", cxxopts::value<std::vector<std::string>>())
+        ("h,help", "Print help");
+    options.parse_positional({OPTION_FILES});
+    options.positional_help("file...");
+
+    auto result = options.parse(argc, argv);
+
+    if (result.count("help")) {
+        std::cout << options.help() << std::endl;
+        return 0;
+    }
+
+    if (result.count(OPTION_FILES) == 0) {
+        throw std::invalid_argument("Missing required arguments");
+        return 1;
+    }
+
+    std::pair<double, double> baseScale = parseBounds(result[OPTION_BASE_SCALE].as<std::string>());
+    std::vector<std::array<double, 2>> scales;
+    if (result.count(OPTION_SCALES)) {
+        for (const auto& [dimensionIndex, low, high, marginal] : parseOverrides(result[OPTION_SCALES].as<std::string>())) {
+            if (dimensionIndex < 0) {
+                throw std::invalid_argument("Invalid dimension index in --scale: " + std::to_string(dimensionIndex));
+                return 1;
+            }
+            if (!marginal.isUniform()) {
+                throw std::invalid_argument("Invalid input. Verifying supports only uniform dimension:lower:upper scales.");
+                return 1;
+            }
+            if ((int)scales.size() <= dimensionIndex) {
+                scales.resize(dimensionIndex + 1, {baseScale.first, baseScale.second});
+            }
+            scales[dimensionIndex] = {low, high};
+        }
+    }
+
+    const std::vector<std::string> files = result[OPTION_FILES].as<std::vector<std::string>>();
+    const long violations = result[OPTION_VIOLATIONS].as<long>();
+    const auto started = std::chrono::steady_clock::now();
+    VerifyReport report = verifyDesign(
+        files,
+        result.count(OPTION_DIMENSIONS) ? result[OPTION_DIMENSIONS].as<int>() : 0,
+        scales,
+        {baseScale.first, baseScale.second},
+        std::max(0L, violations)
+    );
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    std::cout << "Checked " << report.rows << " points in " << report.dimensions << " dimensions from " << files.size() << (files.size() == 1 ? " file" : " files") << "\n";
+    for (const Violation& violation : report.first) {
+        std::cout << "Row " << violation.row;
+        if (violation.dimension >= 0) {
+            std::cout << ", dimension " << violation.dimension << ", value " << violation.value;
+        }
+        std::cout << ": " << violation.problem << "\n";
+    }
+    if (report.outOfRange > 0) {
+        std::cout << "Values outside the bounds: " << report.outOfRange << "\n";
+    }
+    if (report.duplicates > 0) {
+        std::cout << "Values in an occupied stratum: " << report.duplicates << "\n";
+    }
+    if (report.malformed > 0) {
+        std::cout << "Malformed rows: " << report.malformed << "\n";
+    }
+    for (int dimensionIndex = 0; dimensionIndex < report.dimensions; dimensionIndex++) {
+        if (report.missing[dimensionIndex] > 0) {
+            std::cout << "Dimension " << dimensionIndex << ": " << report.missing[dimensionIndex] << " empty strata\n";
+        }
+    }
+    std::cout << (report.valid() ? "Valid Latin hypercube" : "Not a Latin hypercube") << " (" << seconds << " s)" << std::endl;
+
+    return report.valid() ? 0 : 1;
+}
+
+// Runs lhc serve: answers design requests on a Unix domain socket from one long-lived
+// process, with a warm thread pool shared by all requests.
+int runServe(int argc, const char* const argv[])
+{
+    const std::string OPTION_SOCKET = "socket";
+    const std::string OPTION_NUMA = "numa";
+
+    cxxopts::Options options("lhc serve", "Serves designs over a Unix domain socket until a client sends a stop request. Requests take the same arguments as lhc, without an output path, slices or shards.");
+
+    options.add_options()
+        (optionKeyFormatter(OPTION_SOCKET), "Required. Path of the socket to listen on", cxxopts::value<std::string>())
+        (OPTION_NUMA, "Optional. NUMA placement for the server, as for generation", cxxopts::value<std::string>())
+        ("h,help", "Print help");
+
+    auto result = options.parse(argc, argv);
+
+    if (result.count("help")) {
+        std::cout << options.help() << std::endl;
+        return 0;
+    }
+
+    if (result.count(OPTION_SOCKET) == 0) {
+        throw std::invalid_argument("Missing required arguments");
+        return 1;
+    }
+
+    ThreadPool pool;
+    if (result.count(OPTION_NUMA)) {
+        applyNumaPolicy(parseNumaPolicy(result[OPTION_NUMA].as<std::string>()), pool);
+    }
+
+    const std::string socketPath = result[OPTION_SOCKET].as<std::string>();
+    DesignServer server(socketPath, [&pool](const std::vector<std::string>& arguments, std::string& data, std::string& message) {
+        std::vector<const char*> argv;
+        for (const std::string& argument : arguments) {
+            argv.push_back(argument.c_str());
+        }
+        std::ostringstream log;
+        const int status = runJob(argv.size(), argv.data(), pool, &log, std::make_unique<StringSink>(data));
+        // the log only matters if there is no design, as for errors, --dry-run and --help
+        if (status != 0 || data.empty()) {
+            message = log.str();
+        }
+        return status;
+    });
+
+    std::cout << "Serving on " << socketPath << " with " << pool.size() << " worker(s)" << std::endl;
+    server.run();
+    std::cout << "Stopped after " << server.stats.requests << " requests" << std::endl;
+    return 0;
+}
+
+// Runs lhc client: sends requests to lhc serve. Arguments after -- form a design request,
+// whose design is written to the output path.
+int runClient(int argc, const char* const argv[])
+{
+    const std::string OPTION_SOCKET = "socket";
+    const std::string OPTION_OUT_PATH = "out-path";
+    const std::string OPTION_REPEAT = "repeat";
+    const std::string OPTION_STATS = "stats";
+    const std::string OPTION_STOP = "stop";
+
+    const std::string OUT_PATH_DEFAULT = "-";
+    const std::string REPEAT_DEFAULT = "1";
+
+    std::vector<std::string> jobArguments;
+    int clientArguments = argc;
+    for (int argument = 1; argument < argc; argument++) {
+        if (std::string(argv[argument]) == "--") {
+            clientArguments = argument;
+            jobArguments.assign(argv + argument + 1, argv + argc);
+            break;
+        }
+    }
+
+    cxxopts::Options options("lhc client", "Sends a request to lhc serve: a design request made of the lhc arguments after --, a stats request or a stop request.");
+
+    options.add_options()
+        (optionKeyFormatter(OPTION_SOCKET), "Required. Path of the server's socket", cxxopts::value<std::string>())
+        (optionKeyFormatter(OPTION_OUT_PATH), "Optional. File for the design, or '-' for stdout", cxxopts::value<std::string>()->default_value(OUT_PATH_DEFAULT))
+        (OPTION_REPEAT, "Optional. Positive integer. Send the design request this many times over one connection and print latency percentiles to stderr", cxxopts::value<long>()->default_value(REPEAT_DEFAULT))
+        (OPTION_STATS, "Optional. Print the server's counters and latency histogram")
+        (OPTION_STOP, "Optional. Stop the server")
+        ("h,help", "Print help");
+    options.positional_help("-- lhc arguments...");
+
+    auto result = options.parse(clientArguments, argv);
+
+    if (result.count("help")) {
+        std::cout << options.help() << std::endl;
+        return 0;
+    }
+
+    const long repeat = result[OPTION_REPEAT].as<long>();
+    if (result.count(OPTION_SOCKET) == 0 || (jobArguments.empty() && !result.count(OPTION_STATS) && !result.count(OPTION_STOP))) {
+        throw std::invalid_argument("Missing required arguments");
+        return 1;
+    }
+    if (repeat <= 0) {
+        throw std::invalid_argument("Invalid input. Number of repeats must be greater than 0.");
+        return 1;
+    }
+
+    const int descriptor = connectSocket(result[OPTION_SOCKET].as<std::string>());
+    std::string message;
+    std::string data;
+
+    if (result.count(OPTION_STATS)) {
+        sendRequest(descriptor, RequestType::Stats, "");
+        receiveResponse(descriptor, message, data);
+        uint64_t counters[5];
+        uint32_t buckets = 0;
+        if (data.size() >= sizeof(counters) + sizeof(buckets)) {
+            std::memcpy(counters, data.data(), sizeof(counters));
+            std::memcpy(&buckets, data.data() + sizeof(counters), sizeof(buckets));
+        }
+        if (data.size() != sizeof(counters) + sizeof(buckets) + buckets * sizeof(uint64_t)) {
+            throw std::runtime_error("Malformed stats response");
+        }
+        std::cout << "Requests: " << counters[0] << " (" << counters[1] << " failed)\n";
+        std::cout << "Data sent: " << formatByteSize(counters[2]) << "\n";
+        std::cout << "Connections: " << counters[3] << "\n";
+        std::cout << "Uptime: " << counters[4] / 1e6 << " s\n";
+        std::cout << "Request latency:\n";
+        for (uint32_t bucket = 0; bucket < buckets; bucket++) {
+            uint64_t count;
+            std::memcpy(&count, data.data() + sizeof(counters) + sizeof(buckets) + bucket * sizeof(uint64_t), sizeof(count));
+            if (count > 0) {
+                std::cout << "  " << (1UL << bucket) << "-" << (2UL << bucket) << " us: " << count << "\n";
+            }
+        }
+        std::cout << std::flush;
+    }
+
+    int status = 0;
+    if (!jobArguments.empty()) {
+        const std::string payload = encodeArguments(jobArguments);
+        std::vector<double> latencies;
+        for (long request = 0; request < repeat && status == 0; request++) {
+            const auto started = std::chrono::steady_clock::now();
+            sendRequest(descriptor, RequestType::Design, payload);
+            status = receiveResponse(descriptor, message, data);
+            latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - started).count());
+        }
+        if (status != 0) {
+            std::cerr << message;
+        } else {
+            std::cout << message << std::flush;
+            const std::string outPath = result[OPTION_OUT_PATH].as<std::string>();
+            if (outPath == OUT_PATH_DEFAULT) {
+                DescriptorSink(STDOUT_FILENO).write(data);
+            } else {
+                std::ofstream out(outPath, std::ios::out | std::ios::trunc | std::ios::binary);
+                out.write(data.data(), data.size());
+                if (!out) {
+                    throw std::invalid_argument("Invalid input. File path is not writable.");
+                    return 1;
+                }
+            }
+        }
+        if (repeat > 1) {
+            std::sort(latencies.begin(), latencies.end());
+            auto percentile = [&latencies](const double fraction) {
+                return latencies[std::min(latencies.size() - 1, (size_t)(fraction * latencies.size()))];
+            };
+            std::cerr << latencies.size() << " requests, latency in microseconds: median " << percentile(0.5) << ", p99 " << percentile(0.99) << ", max " << latencies.back() << std::endl;
+        }
+    }
+
+    if (result.count(OPTION_STOP)) {
+        sendRequest(descriptor, RequestType::Stop, "");
+        receiveResponse(descriptor, message, data);
+        std::cout << message << std::endl;
+    }
+
+    ::close(descriptor);
+    return status == 0 ? 0 : 1;
+}
+
+// src/lhc_capi.cpp compiles this file into the library without main()
+#ifndef LHC_NO_MAIN
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && std::string(argv[1]) == "verify") {
+        return runVerify(argc - 1, argv + 1);
+    }
+    if (argc > 1 && std::string(argv[1]) == "serve") {
+        return runServe(argc - 1, argv + 1);
+    }
+    if (argc > 1 && std::string(argv[1]) == "client") {
+        return runClient(argc - 1, argv + 1);
+    }
+
+    ThreadPool pool; // formats and compresses output blocks, shared by batch jobs
+    return runJob(argc, argv, pool, nullptr);
+}
+#endif
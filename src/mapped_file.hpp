@@ -0,0 +1,57 @@
+#pragma once
+
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read-only memory map of a whole file. The pages are faulted in on demand, so even very
+// large files cost nothing until they are read, and nothing is copied into the process.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        int descriptor = ::open(path.c_str(), O_RDONLY);
+        if (descriptor < 0) {
+            throw std::invalid_argument("Invalid input. Cannot open file: " + path);
+        }
+        struct stat status;
+        if (::fstat(descriptor, &status) != 0) {
+            ::close(descriptor);
+            throw std::invalid_argument("Invalid input. Cannot read file: " + path);
+        }
+        length = status.st_size;
+        if (length > 0) {
+            void* address = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (address == MAP_FAILED) {
+                ::close(descriptor);
+                throw std::invalid_argument("Invalid input. Cannot map file: " + path);
+            }
+            bytes = static_cast<const char*>(address);
+            ::madvise(address, length, MADV_SEQUENTIAL);
+        }
+        ::close(descriptor);
+    }
+
+    ~MappedFile() {
+        if (bytes != nullptr) {
+            ::munmap(const_cast<char*>(bytes), length);
+        }
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const {
+        return bytes;
+    }
+
+    size_t size() const {
+        return length;
+    }
+
+private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+};
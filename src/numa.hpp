@@ -0,0 +1,194 @@
+/******************************************************************************
+
+NUMA placement.
+
+On a machine with several memory nodes a page lives on the node of the thread
+that first writes it. Buffers that one thread zeroes when they are allocated
+therefore end up on a single node, and every worker on another node pays for
+remote memory when it later fills or reads its part.
+
+--numa first-touch pins the workers to the nodes in contiguous groups and has
+every worker fault in the pages of the tiles it will work on. The pool hands
+tile t to worker t % workers, and placeTiles() uses the same rule, so the
+pages of a tile sit on the node of the worker that processes it.
+--numa interleave spreads new pages round-robin over all nodes instead, which
+needs no knowledge of who uses what and evens out the bandwidth.
+
+The topology is read from sysfs and the policies are set with the raw system
+calls, so no libnuma is needed. On a machine with a single node both policies
+are harmless no-ops apart from the pinning.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sched.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+#include "parallel.hpp"
+
+enum class NumaPolicy { Off, Interleave, FirstTouch };
+
+// Buffers smaller than this are not worth placing.
+constexpr size_t NUMA_PLACEMENT_MIN_BYTES = 1 << 22;
+
+// from <linux/mempolicy.h>
+constexpr int NUMA_MPOL_INTERLEAVE = 3;
+
+inline NumaPolicy parseNumaPolicy(const std::string& name) {
+    if (name == "off") {
+        return NumaPolicy::Off;
+    }
+    if (name == "interleave") {
+        return NumaPolicy::Interleave;
+    }
+    if (name == "first-touch") {
+        return NumaPolicy::FirstTouch;
+    }
+    throw std::invalid_argument("Invalid input. Unknown NUMA policy: " + name);
+}
+
+// The policy in force for the process, set by applyNumaPolicy().
+inline NumaPolicy& numaPolicy() {
+    static NumaPolicy policy = NumaPolicy::Off;
+    return policy;
+}
+
+// Parses a sysfs list such as "0-3,8-11".
+inline std::vector<int> parseCpuList(const std::string& list) {
+    std::vector<int> values;
+    size_t position = 0;
+    while (position < list.size()) {
+        size_t comma = list.find(',', position);
+        std::string range = list.substr(position, comma == std::string::npos ? std::string::npos : comma - position);
+        position = comma == std::string::npos ? list.size() : comma + 1;
+        if (range.empty() || !std::isdigit((unsigned char)range[0])) {
+            continue;
+        }
+        size_t dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int value = first; value <= last; value++) {
+            values.push_back(value);
+        }
+    }
+    return values;
+}
+
+struct NumaNode {
+    int id;
+    std::vector<int> cpus;
+};
+
+// The online nodes that have CPUs, or a single node 0 without CPUs if sysfs does not say.
+inline std::vector<NumaNode> numaNodes() {
+    std::vector<NumaNode> nodes;
+    std::ifstream online("/sys/devices/system/node/online");
+    std::string line;
+    if (std::getline(online, line)) {
+        for (int id : parseCpuList(line)) {
+            std::ifstream cpuList("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+            std::string cpus;
+            std::getline(cpuList, cpus);
+            NumaNode node{id, parseCpuList(cpus)};
+            if (!node.cpus.empty()) {
+                nodes.push_back(node);
+            }
+        }
+    }
+    if (nodes.empty()) {
+        nodes.push_back({0, {}});
+    }
+    return nodes;
+}
+
+// Sets the policy for the calling thread and every worker of the pool. Workers are pinned
+// to the CPUs of their node, worker w to node w * nodes / workers; with interleave, new
+// pages of every thread are also spread over all nodes.
+inline void applyNumaPolicy(const NumaPolicy policy, ThreadPool& pool) {
+    numaPolicy() = policy;
+    if (policy == NumaPolicy::Off) {
+        return;
+    }
+    const std::vector<NumaNode> nodes = numaNodes();
+
+    std::vector<unsigned long> nodeMask(1);
+    for (const NumaNode& node : nodes) {
+        const size_t word = node.id / (8 * sizeof(unsigned long));
+        nodeMask.resize(std::max(nodeMask.size(), word + 1));
+        nodeMask[word] |= 1UL << (node.id % (8 * sizeof(unsigned long)));
+    }
+    auto interleave = [&]() {
+        if (::syscall(SYS_set_mempolicy, NUMA_MPOL_INTERLEAVE, nodeMask.data(), nodeMask.size() * 8 * sizeof(unsigned long) + 1) != 0) {
+            throw std::runtime_error(std::string("Failed to set the NUMA memory policy: ") + std::strerror(errno));
+        }
+    };
+    if (policy == NumaPolicy::Interleave) {
+        interleave();
+    }
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (::sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        throw std::runtime_error(std::string("Failed to read the CPU affinity: ") + std::strerror(errno));
+    }
+    pool.onEachWorker([&](const size_t worker) {
+        const NumaNode& node = nodes[worker * nodes.size() / pool.size()];
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (int cpu : node.cpus) {
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) {
+                CPU_SET(cpu, &cpus);
+            }
+        }
+        // a node outside the allowed CPUs (a restricted cpuset) leaves the worker unpinned
+        if (CPU_COUNT(&cpus) > 0 && ::sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+            throw std::runtime_error(std::string("Failed to pin a worker to NUMA node ") + std::to_string(node.id) + ": " + std::strerror(errno));
+        }
+        if (policy == NumaPolicy::Interleave) {
+            interleave();
+        }
+    });
+}
+
+// Under first-touch, hands the pages of a freshly zero-initialised buffer to the workers
+// that will process them: tile t, elements [t * tileElements, (t + 1) * tileElements),
+// goes to pool.workerFor(t). The whole pages of the buffer are released with
+// MADV_DONTNEED, after which they read as zeros again, and each worker then faults in
+// those of its own tiles. Does nothing under the other policies or for small buffers.
+template <class T>
+void placeTiles(std::vector<T>& buffer, const long tileElements, ThreadPool& pool) {
+    const size_t bytes = buffer.size() * sizeof(T);
+    if (numaPolicy() != NumaPolicy::FirstTouch || bytes < NUMA_PLACEMENT_MIN_BYTES || tileElements <= 0) {
+        return;
+    }
+    const uintptr_t pageSize = ::sysconf(_SC_PAGESIZE);
+    const uintptr_t start = (uintptr_t)buffer.data();
+    const uintptr_t firstPage = (start + pageSize - 1) / pageSize * pageSize;
+    const uintptr_t lastPage = (start + bytes) / pageSize * pageSize;
+    if (lastPage <= firstPage || ::madvise((void*)firstPage, lastPage - firstPage, MADV_DONTNEED) != 0) {
+        return; // the pages stay where they are, which is correct, only not placed
+    }
+
+    const long tiles = (buffer.size() + tileElements - 1) / tileElements;
+    const uintptr_t tileBytes = tileElements * sizeof(T);
+    pool.onEachWorker([&](const size_t worker) {
+        for (long tile = worker; tile < tiles; tile += pool.size()) {
+            const uintptr_t tileStart = std::max(firstPage, (start + tile * tileBytes + pageSize - 1) / pageSize * pageSize);
+            const uintptr_t tileEnd = std::min(lastPage, start + (tile + 1) * tileBytes);
+            for (uintptr_t page = tileStart; page < tileEnd; page += pageSize) {
+                *(volatile char*)page = 0;
+            }
+        }
+    });
+}
@@ -0,0 +1,286 @@
+/******************************************************************************
+
+Orthogonal-array-based Latin hypercube construction (Tang, 1993).
+
+An orthogonal array OA(s^t, D, s, t) has s^t rows and D columns over s symbols,
+and every t columns contain each t-tuple of symbols equally often. Expanding
+each symbol into a block of s^(t-1) strata yields a Latin hypercube whose
+projections onto any t dimensions are stratified on an s x ... x s grid.
+
+The arrays come from the Bose (t = 2) and Bush (t >= 3) constructions: rows
+are the polynomials of degree < t over GF(s), and each column evaluates them at
+one field element, plus one extra column holding the leading coefficient.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "progress.hpp"
+
+// Arithmetic over the finite field GF(p^k). Elements are encoded as integers
+// whose base-p digits are the polynomial coefficients.
+struct GaloisField {
+    long order = 0;          // number of elements, p^k
+    long prime = 0;          // characteristic p
+    int power = 0;           // extension degree k
+    std::vector<long> exp;   // antilog table, exp[i] = g^i for 0 <= i < 2 * (order - 1)
+    std::vector<long> log;   // log table, log[a] for a != 0
+
+    long add(long a, long b) const {
+        if (power == 1) {
+            long sum = a + b;
+            return sum >= prime ? sum - prime : sum;
+        }
+        if (prime == 2) {
+            return a ^ b;
+        }
+        // digitwise addition mod p
+        long sum = 0, place = 1;
+        for (int digit = 0; digit < power; digit++) {
+            sum += ((a % prime + b % prime) % prime) * place;
+            a /= prime;
+            b /= prime;
+            place *= prime;
+        }
+        return sum;
+    }
+
+    long mul(long a, long b) const {
+        if (power == 1) {
+            return (a * b) % prime;
+        }
+        if (a == 0 || b == 0) {
+            return 0;
+        }
+        return exp[log[a] + log[b]];
+    }
+};
+
+// Returns p if n is a power of the prime p, 0 otherwise. Also reports the exponent.
+inline long primePowerBase(long n, int& power) {
+    power = 0;
+    if (n < 2) {
+        return 0;
+    }
+
+    long base = n;
+    for (long factor = 2; factor * factor <= n; factor++) {
+        if (n % factor == 0) {
+            base = factor;
+            break;
+        }
+    }
+
+    long remainder = n;
+    while (remainder % base == 0) {
+        remainder /= base;
+        power++;
+    }
+    return remainder == 1 ? base : 0;
+}
+
+inline GaloisField makeGaloisField(long order) {
+    GaloisField field;
+    field.order = order;
+    field.prime = primePowerBase(order, field.power);
+    if (field.prime == 0) {
+        throw std::invalid_argument("Invalid input. " + std::to_string(order) + " is not a prime power.");
+    }
+    if (field.power == 1) {
+        return field;
+    }
+
+    const long p = field.prime;
+    const int k = field.power;
+
+    // multiplies an element by x modulo the monic polynomial x^k + modulus(x)
+    auto timesX = [&](long element, const std::vector<long>& modulus) {
+        std::vector<long> digits(k + 1, 0);
+        for (int digit = 0; digit < k; digit++) {
+            digits[digit + 1] = element % p;
+            element /= p;
+        }
+        long lead = digits[k];
+        long result = 0, place = 1;
+        for (int digit = 0; digit < k; digit++) {
+            result += ((digits[digit] + (p - lead) * modulus[digit]) % p) * place;
+            place *= p;
+        }
+        return result;
+    };
+
+    // search for a primitive polynomial, i.e. one for which x generates every nonzero element
+    for (long candidate = 1; candidate < order; candidate++) {
+        std::vector<long> modulus(k);
+        long rest = candidate;
+        for (int digit = 0; digit < k; digit++) {
+            modulus[digit] = rest % p;
+            rest /= p;
+        }
+        if (modulus[0] == 0) {
+            continue; // divisible by x
+        }
+
+        field.exp.assign(2 * (order - 1), 0);
+        field.log.assign(order, -1);
+        long element = 1;
+        bool primitive = true;
+        for (long i = 0; i < order - 1; i++) {
+            if (field.log[element] != -1) {
+                primitive = false;
+                break;
+            }
+            field.exp[i] = element;
+            field.log[element] = i;
+            element = timesX(element, modulus);
+        }
+        if (primitive && element == 1) {
+            for (long i = order - 1; i < 2 * (order - 1); i++) {
+                field.exp[i] = field.exp[i - (order - 1)];
+            }
+            return field;
+        }
+    }
+
+    throw std::invalid_argument("Invalid input. No primitive polynomial found for GF(" + std::to_string(order) + ").");
+}
+
+// Returns s such that s^strength == numberOfPoints, or 0 if there is none.
+inline long integerRoot(long numberOfPoints, int strength) {
+    long guess = std::lround(std::pow((double)numberOfPoints, 1.0 / strength));
+    for (long s = std::max(2L, guess - 1); s <= guess + 1; s++) {
+        long power = 1;
+        for (int i = 0; i < strength && power <= numberOfPoints; i++) {
+            power *= s;
+        }
+        if (power == numberOfPoints) {
+            return s;
+        }
+    }
+    return 0;
+}
+
+// Builds the columns of OA(s^t, columns, s, t) with the Bose (t = 2) or Bush (t >= 3) construction.
+// Column j < s evaluates each polynomial at field element j; column s holds the leading coefficient.
+// Each column is filled in closed form: the block of rows with a higher coefficient k is the
+// lower block plus the constant k * w_i, so every inner loop is a flat, vectorisable pass.
+inline std::vector<std::vector<long>> buildOrthogonalArray(const GaloisField& field, int strength, int columns) {
+    const long s = field.order;
+    long rows = 1;
+    for (int i = 0; i < strength; i++) {
+        rows *= s;
+    }
+
+    std::vector<std::vector<long>> array(columns, std::vector<long>(rows));
+    for (int columnIndex = 0; columnIndex < columns; columnIndex++) {
+        // weights w_i: powers of the evaluation point, or a unit vector on the leading coefficient
+        std::vector<long> weights(strength, 0);
+        if (columnIndex < s) {
+            weights[0] = 1;
+            for (int i = 1; i < strength; i++) {
+                weights[i] = field.mul(weights[i - 1], columnIndex);
+            }
+        } else {
+            weights[strength - 1] = 1;
+        }
+
+        std::vector<long>& column = array[columnIndex];
+        column[0] = 0;
+        long stride = 1;
+        for (int i = 0; i < strength; i++) {
+            for (long coefficient = 1; coefficient < s; coefficient++) {
+                const long offset = field.mul(coefficient, weights[i]);
+                long* block = column.data() + coefficient * stride;
+                const long* base = column.data();
+                if (field.power == 1) {
+                    for (long m = 0; m < stride; m++) {
+                        long sum = base[m] + offset;
+                        block[m] = sum >= s ? sum - s : sum;
+                    }
+                } else if (field.prime == 2) {
+                    for (long m = 0; m < stride; m++) {
+                        block[m] = base[m] ^ offset;
+                    }
+                } else {
+                    for (long m = 0; m < stride; m++) {
+                        block[m] = field.add(base[m], offset);
+                    }
+                }
+            }
+            stride *= s;
+        }
+    }
+
+    return array;
+}
+
+// Generates the strata of an OA-based Latin hypercube. Each returned column is a permutation
+// of 0..numberOfPoints-1 in which the rows sharing an OA symbol occupy one contiguous block
+// of strata, so the design inherits the strength of the orthogonal array. Each finished
+// column advances progress, if given, by its values.
+inline std::vector<std::vector<long>> orthogonalArrayStrata(
+    const long numberOfPoints,
+    const int numberOfDimensions,
+    const int strength,
+    std::mt19937& generator,
+    Progress* progress = nullptr
+) {
+    if (strength < 2) {
+        throw std::invalid_argument("Invalid input. Orthogonal array strength must be at least 2.");
+    }
+
+    const long s = integerRoot(numberOfPoints, strength);
+    if (s == 0) {
+        throw std::invalid_argument("Invalid input. Method 'oa' with strength " + std::to_string(strength) + " requires the number of points to be s^" + std::to_string(strength) + " for a prime power s.");
+    }
+    GaloisField field = makeGaloisField(s);
+
+    if (strength > s + 1) {
+        throw std::invalid_argument("Invalid input. Orthogonal array strength " + std::to_string(strength) + " requires at least " + std::to_string(strength - 1) + " levels.");
+    }
+    if (numberOfDimensions > s + 1) {
+        throw std::invalid_argument("Invalid input. Method 'oa' with " + std::to_string(s) + " levels supports at most " + std::to_string(s + 1) + " dimensions.");
+    }
+
+    std::vector<std::vector<long>> strata = buildOrthogonalArray(field, strength, numberOfDimensions);
+    const long blockSize = numberOfPoints / s;
+
+    // random row order, shared by all columns so that the array structure is preserved
+    std::vector<long> rowOrder(numberOfPoints);
+    std::iota(rowOrder.begin(), rowOrder.end(), 0);
+    std::shuffle(rowOrder.begin(), rowOrder.end(), generator);
+
+    std::vector<long> symbols(s);
+    std::vector<long> withinBlock(numberOfPoints);
+    std::vector<long> used(s);
+    std::vector<long> expanded(numberOfPoints);
+    for (std::vector<long>& column : strata) {
+        // relabel the symbols, then give the rows of each symbol a random order inside its block
+        std::iota(symbols.begin(), symbols.end(), 0);
+        std::shuffle(symbols.begin(), symbols.end(), generator);
+        for (long level = 0; level < s; level++) {
+            long* block = withinBlock.data() + level * blockSize;
+            std::iota(block, block + blockSize, 0);
+            std::shuffle(block, block + blockSize, generator);
+        }
+
+        std::fill(used.begin(), used.end(), 0);
+        for (long rowIndex = 0; rowIndex < numberOfPoints; rowIndex++) {
+            long level = symbols[column[rowIndex]];
+            expanded[rowOrder[rowIndex]] = level * blockSize + withinBlock[level * blockSize + used[level]++];
+        }
+        column.swap(expanded);
+        if (progress != nullptr) {
+            progress->advance(numberOfPoints);
+        }
+    }
+
+    return strata;
+}
@@ -0,0 +1,380 @@
+/******************************************************************************
+
+Output sinks.
+
+The CSV text is produced in blocks of about OUTPUT_BLOCK_SIZE bytes and handed
+to a sink in order. An asynchronous sink sits in front of the chain and passes
+the blocks to a dedicated I/O thread, so the next blocks are generated while
+the previous ones are written, and it recycles the written buffers. A plain sink writes each block as it arrives, to a
+stream, straight to a file descriptor or into a string. On a pipe a full buffer
+simply blocks the writer. A compressed sink wraps another sink. It compresses every block
+independently on the thread pool while the next blocks are being formatted,
+and passes the results on in order. Each block becomes its own gzip member or
+zstd frame, and concatenations of those are valid streams that standard tools
+decompress as one file.
+
+gzip support needs -DLHC_WITH_ZLIB -lz, and zstd support -DLHC_WITH_ZSTD -lzstd.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <future>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include "parallel.hpp"
+
+#ifdef LHC_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef LHC_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+constexpr size_t OUTPUT_BLOCK_SIZE = 1 << 20;
+
+enum class Compression { None, Gzip, Zstd };
+
+inline bool endsWith(const std::string& text, const std::string& suffix) {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Inserts a zero-padded index before the extension of a path: "lhc.csv" -> "lhc.003.csv".
+// A compression suffix stays last: "lhc.csv.gz" -> "lhc.003.csv.gz".
+inline std::string shardPath(const std::string& path, const long index, const long count) {
+    for (const std::string suffix : {".gz", ".zst"}) {
+        if (path.size() > suffix.size() && endsWith(path, suffix)) {
+            return shardPath(path.substr(0, path.size() - suffix.size()), index, count) + suffix;
+        }
+    }
+
+    std::string number = std::to_string(index);
+    const size_t width = std::max<size_t>(3, std::to_string(std::max(0L, count - 1)).size());
+    number = std::string(width > number.size() ? width - number.size() : 0, '0') + number;
+
+    const size_t slash = path.find_last_of('/');
+    const size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash) || dot == (slash == std::string::npos ? 0 : slash + 1)) {
+        return path + "." + number;
+    }
+    return path.substr(0, dot) + "." + number + path.substr(dot);
+}
+
+// The manifest that lists the shards of a path: "lhc.csv.gz" -> "lhc.manifest.csv".
+inline std::string manifestPath(const std::string& path) {
+    std::string first = shardPath(path, 0, 1);
+    std::string marker = "." + std::string(3, '0');
+    size_t position = first.rfind(marker);
+    return first.substr(0, position) + ".manifest.csv";
+}
+
+// Resolves --compress; an empty name picks the format from the output path's extension.
+inline Compression parseCompression(const std::string& name, const std::string& path) {
+    if (name == "none") {
+        return Compression::None;
+    }
+    if (name == "gzip" || (name.empty() && endsWith(path, ".gz"))) {
+#ifndef LHC_WITH_ZLIB
+        throw std::invalid_argument("Invalid input. gzip output requires building with -DLHC_WITH_ZLIB -lz.");
+#endif
+        return Compression::Gzip;
+    }
+    if (name == "zstd" || (name.empty() && endsWith(path, ".zst"))) {
+#ifndef LHC_WITH_ZSTD
+        throw std::invalid_argument("Invalid input. zstd output requires building with -DLHC_WITH_ZSTD -lzstd.");
+#endif
+        return Compression::Zstd;
+    }
+    if (name.empty()) {
+        return Compression::None;
+    }
+    throw std::invalid_argument("Invalid input. Unknown compression: " + name);
+}
+
+// Compresses one block into a self-contained gzip member or zstd frame.
+inline std::string compressBlock([[maybe_unused]] const Compression compression, const std::string& block) {
+#ifdef LHC_WITH_ZLIB
+    if (compression == Compression::Gzip) {
+        z_stream stream{};
+        if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error("Failed to initialise gzip compression");
+        }
+        std::string compressed(deflateBound(&stream, block.size()), '\0');
+        stream.next_in = (Bytef*)block.data();
+        stream.avail_in = block.size();
+        stream.next_out = (Bytef*)&compressed[0];
+        stream.avail_out = compressed.size();
+        int status = deflate(&stream, Z_FINISH);
+        compressed.resize(stream.total_out);
+        deflateEnd(&stream);
+        if (status != Z_STREAM_END) {
+            throw std::runtime_error("Failed to gzip an output block");
+        }
+        return compressed;
+    }
+#endif
+#ifdef LHC_WITH_ZSTD
+    if (compression == Compression::Zstd) {
+        std::string compressed(ZSTD_compressBound(block.size()), '\0');
+        size_t length = ZSTD_compress(&compressed[0], compressed.size(), block.data(), block.size(), 3);
+        if (ZSTD_isError(length)) {
+            throw std::runtime_error(std::string("Failed to zstd an output block: ") + ZSTD_getErrorName(length));
+        }
+        compressed.resize(length);
+        return compressed;
+    }
+#endif
+    return block;
+}
+
+// Receives the output text block by block, in order. write() may take the block's
+// contents and leave a spare buffer in its place; the caller clears it and reuses it.
+class OutputSink {
+public:
+    virtual ~OutputSink() = default;
+    virtual void write(std::string& block) = 0;
+    virtual void finish() = 0;
+};
+
+class StreamSink : public OutputSink {
+public:
+    explicit StreamSink(std::ostream& out) : out(out) {}
+
+    void write(std::string& block) override {
+        out.write(block.data(), block.size());
+    }
+
+    void finish() override {
+        out.flush();
+    }
+
+private:
+    std::ostream& out;
+};
+
+// Writes blocks with write(2), retrying partial writes. On a pipe this blocks while the
+// reader is behind, so at most one block is held regardless of the size of the design.
+class DescriptorSink : public OutputSink {
+public:
+    explicit DescriptorSink(const int descriptor) : descriptor(descriptor) {}
+
+    void write(std::string& block) override {
+        const char* cursor = block.data();
+        size_t remaining = block.size();
+        while (remaining > 0) {
+            ssize_t written = ::write(descriptor, cursor, remaining);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error(std::string("Failed to write output: ") + std::strerror(errno));
+            }
+            cursor += written;
+            remaining -= written;
+        }
+    }
+
+    void finish() override {}
+
+private:
+    const int descriptor;
+};
+
+// Appends blocks to a string owned by the caller, such as a reused response buffer.
+class StringSink : public OutputSink {
+public:
+    explicit StringSink(std::string& target) : target(target) {}
+
+    void write(std::string& block) override {
+        target += block;
+    }
+
+    void finish() override {}
+
+private:
+    std::string& target;
+};
+
+// CRC-32 (IEEE 802.3, as used by gzip and zip), table driven.
+inline uint32_t crc32Update(uint32_t crc, const char* data, const size_t length) {
+    static const std::array<uint32_t, 256> table = []() {
+        std::array<uint32_t, 256> entries{};
+        for (uint32_t byte = 0; byte < 256; byte++) {
+            uint32_t value = byte;
+            for (int bit = 0; bit < 8; bit++) {
+                value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+            }
+            entries[byte] = value;
+        }
+        return entries;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ (unsigned char)data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// Passes blocks through unchanged while counting their bytes and CRC-32.
+class ChecksumSink : public OutputSink {
+public:
+    explicit ChecksumSink(std::unique_ptr<OutputSink> inner) : inner(std::move(inner)) {}
+
+    void write(std::string& block) override {
+        crc = crc32Update(crc, block.data(), block.size());
+        bytes += block.size();
+        inner->write(block);
+    }
+
+    void finish() override {
+        inner->finish();
+    }
+
+    uint32_t crc = 0;
+    uint64_t bytes = 0;
+
+private:
+    std::unique_ptr<OutputSink> inner;
+};
+
+// Compresses blocks on the pool and passes them to the wrapped sink in submission order.
+// At most two blocks per worker are in flight, which bounds memory and lets the producer
+// run ahead.
+class CompressedSink : public OutputSink {
+public:
+    CompressedSink(std::unique_ptr<OutputSink> inner, const Compression compression, ThreadPool& pool)
+        : inner(std::move(inner)), compression(compression), pool(pool) {}
+
+    void write(std::string& block) override {
+        const Compression format = compression;
+        pending.push_back(pool.submit([format, block = std::move(block)]() { return compressBlock(format, block); }));
+        while (pending.size() > 2 * pool.size()) {
+            writeOldest();
+        }
+    }
+
+    void finish() override {
+        while (!pending.empty()) {
+            writeOldest();
+        }
+        inner->finish();
+    }
+
+private:
+    void writeOldest() {
+        std::string compressed = pool.await(pending.front());
+        pending.pop_front();
+        inner->write(compressed);
+    }
+
+    std::unique_ptr<OutputSink> inner;
+    const Compression compression;
+    ThreadPool& pool;
+    std::deque<std::future<std::string>> pending;
+};
+
+// Buffers in circulation between the producer and the I/O thread of an AsyncSink.
+constexpr size_t ASYNC_BUFFERS = 4;
+
+// Hands blocks to a dedicated I/O thread through a lock-free ring, so the producer formats
+// the next blocks while the previous ones are written. The I/O thread sleeps while there
+// is nothing to write. Written buffers come back on a
+// second ring and are swapped in for the blocks the producer hands over, so once
+// ASYNC_BUFFERS buffers exist the steady state allocates nothing. An error on the I/O
+// thread is rethrown by the next write() or by finish().
+class AsyncSink : public OutputSink {
+public:
+    explicit AsyncSink(std::unique_ptr<OutputSink> inner)
+        : inner(std::move(inner)), writer([this, depth = ThreadPool::depth()]() {
+              ThreadPool::adoptDepth(depth); // a compressing inner sink waits on the pool
+              drain();
+          }) {}
+
+    ~AsyncSink() override {
+        stop();
+    }
+
+    void write(std::string& block) override {
+        rethrowFailure();
+        std::string spare;
+        if (!spares.tryPop(spare)) {
+            if (allocated < ASYNC_BUFFERS) {
+                allocated++;
+            } else {
+                spares.pop(spare);
+            }
+        }
+        filled.push(block);
+        block = std::move(spare);
+    }
+
+    void finish() override {
+        stop();
+        rethrowFailure();
+        inner->finish();
+    }
+
+private:
+    void drain() {
+        std::string block;
+        while (filled.pop(block)) {
+            if (!failed.load(std::memory_order_relaxed)) {
+                try {
+                    inner->write(block);
+                } catch (...) {
+                    failure = std::current_exception();
+                    failed.store(true, std::memory_order_release);
+                }
+            }
+            block.clear();
+            spares.push(block);
+        }
+    }
+
+    void stop() {
+        if (writer.joinable()) {
+            filled.close();
+            writer.join();
+        }
+    }
+
+    void rethrowFailure() {
+        if (failed.load(std::memory_order_acquire)) {
+            std::rethrow_exception(failure);
+        }
+    }
+
+    std::unique_ptr<OutputSink> inner;
+    SpscQueue<std::string, ASYNC_BUFFERS> filled;
+    SpscQueue<std::string, ASYNC_BUFFERS + 1> spares;
+    size_t allocated = 0;
+    std::atomic<bool> failed{false};
+    std::exception_ptr failure;
+    std::thread writer;
+};
+
+// Builds the chain in front of a destination: asynchronous hand-off, then compression.
+// Outputs written side by side, such as shards, already overlap each other's I/O, and
+// served designs go to memory, so they pass async = false and write on the thread that
+// commits the blocks instead of starting an I/O thread each.
+inline std::unique_ptr<OutputSink> makeSink(std::unique_ptr<OutputSink> destination, const Compression compression, ThreadPool& pool, const bool async = true) {
+    if (compression != Compression::None) {
+        destination = std::make_unique<CompressedSink>(std::move(destination), compression, pool);
+    }
+    if (!async) {
+        return destination;
+    }
+    return std::make_unique<AsyncSink>(std::move(destination));
+}
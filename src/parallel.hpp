@@ -0,0 +1,426 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs task(index) for every index in [0, count) on up to one thread per core.
+// Indices are handed out in increasing order; the first exception thrown by a task
+// is rethrown on the calling thread once every worker has finished.
+template <class Task>
+void parallelFor(const long count, Task task) {
+    const long workers = std::min<long>(count, std::max(1u, std::thread::hardware_concurrency()));
+    std::atomic<long> next{0};
+    std::exception_ptr failure;
+    std::mutex failureMutex;
+
+    auto work = [&]() {
+        for (long index = next++; index < count; index = next++) {
+            try {
+                task(index);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(failureMutex);
+                if (!failure) {
+                    failure = std::current_exception();
+                }
+                next = count; // stop handing out work
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (long worker = 1; worker < workers; worker++) {
+        threads.emplace_back(work);
+    }
+    work();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
+
+// Waits politely in a polling loop: yields for a while, then sleeps in short steps.
+class Backoff {
+public:
+    void pause() {
+        if (++spins < 64) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+
+private:
+    int spins = 0;
+};
+
+// A fixed set of worker threads with one task deque each (work stealing). A worker takes
+// its newest task first, which keeps the tiles it has just created warm in its cache, and
+// steals the oldest task of another worker when its own deque is empty, trying the
+// neighbouring workers first. Tasks submitted from outside the pool are dealt round-robin
+// over the deques. Tiles (forEach() indices, and tasks submitted with a tile number) go to
+// worker tile % workers instead, so that a tile lands where placeTiles() in numa.hpp put
+// its pages when the workers are pinned to NUMA nodes.
+//
+// Threads that wait for tasks (await(), forEach()) run queued tasks meanwhile instead of
+// blocking, so tasks may submit and wait for further tasks without deadlocking the pool.
+// Every task has the nesting depth of the task that submitted it plus one, and a waiting
+// thread only runs tasks deeper than the one it is running itself: the blocks of a shard
+// may be run by any thread waiting for blocks, but never a whole sibling shard, which
+// would wait in turn and stack shards on top of each other. The deepest waiter can always
+// run the tasks it waits for, so this cannot deadlock. The destructor finishes queued
+// tasks before joining.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threads = std::max(1u, std::thread::hardware_concurrency())) {
+        for (unsigned thread = 0; thread < threads; thread++) {
+            queues.push_back(std::make_unique<WorkerQueue>());
+        }
+        for (unsigned thread = 0; thread < threads; thread++) {
+            workers.emplace_back([this, thread]() { work(thread); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template <class Task>
+    auto submit(Task task) -> std::future<decltype(task())> {
+        auto packaged = std::make_shared<std::packaged_task<decltype(task())()>>(std::move(task));
+        std::future<decltype(task())> result = packaged->get_future();
+        push([packaged]() { (*packaged)(); }, ANY_WORKER);
+        return result;
+    }
+
+    // Submits a task that works on the given tile, to the worker that owns the tile.
+    template <class Task>
+    auto submit(Task task, const long tile) -> std::future<decltype(task())> {
+        auto packaged = std::make_shared<std::packaged_task<decltype(task())()>>(std::move(task));
+        std::future<decltype(task())> result = packaged->get_future();
+        push([packaged]() { (*packaged)(); }, workerFor(tile));
+        return result;
+    }
+
+    // Waits for a task's result, running other tasks meanwhile.
+    template <class T>
+    T await(std::future<T>& result) {
+        for (Backoff backoff; result.wait_for(std::chrono::seconds(0)) != std::future_status::ready;) {
+            if (!runOne(currentDepth + 1)) {
+                backoff.pause();
+            }
+        }
+        return result.get();
+    }
+
+    // Runs task(index) for every index in [0, count) as separate tiles and waits for all of
+    // them, helping meanwhile. The first exception thrown by a task is rethrown here.
+    template <class Task>
+    void forEach(const long count, Task task) {
+        std::atomic<long> remaining{count};
+        std::exception_ptr failure;
+        std::mutex failureMutex;
+        for (long index = 0; index < count; index++) {
+            push([&, index]() {
+                try {
+                    task(index);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(failureMutex);
+                    if (!failure) {
+                        failure = std::current_exception();
+                    }
+                }
+                remaining.fetch_sub(1, std::memory_order_release);
+            }, workerFor(index));
+        }
+        for (Backoff backoff; remaining.load(std::memory_order_acquire) > 0;) {
+            if (!runOne(currentDepth + 1)) {
+                backoff.pause();
+            }
+        }
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+    }
+
+    // Runs task(worker) once on every worker thread, for per-thread settings such as CPU
+    // affinity or pages that a particular worker should touch first, and waits until all
+    // have run. The first exception thrown by a task is rethrown here.
+    void onEachWorker(const std::function<void(size_t)>& task) {
+        std::atomic<size_t> remaining{workers.size()};
+        std::exception_ptr failure;
+        std::mutex failureMutex;
+        for (size_t worker = 0; worker < workers.size(); worker++) {
+            std::lock_guard<std::mutex> lock(queues[worker]->mutex);
+            queues[worker]->pinned.push_back([&, worker]() {
+                try {
+                    task(worker);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(failureMutex);
+                    if (!failure) {
+                        failure = std::current_exception();
+                    }
+                }
+                remaining.fetch_sub(1, std::memory_order_release);
+            });
+            queues[worker]->pinnedCount.fetch_add(1, std::memory_order_release);
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        wakeUp.notify_all(); // only the owners can run these, so wake them all
+        for (Backoff backoff; remaining.load(std::memory_order_acquire) > 0;) {
+            if (!runOne(currentDepth + 1)) {
+                backoff.pause();
+            }
+        }
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+    }
+
+    size_t size() const {
+        return workers.size();
+    }
+
+    // The worker that runs tile `tile`.
+    size_t workerFor(const long tile) const {
+        return (size_t)tile % workers.size();
+    }
+
+    // The nesting depth of the task the calling thread is running, 0 outside of tasks. A
+    // thread that works on behalf of a task, such as the I/O thread of a sink, adopts the
+    // task's depth so that it waits like the task would and never runs a sibling of it.
+    static int depth() {
+        return currentDepth;
+    }
+
+    static void adoptDepth(const int depth) {
+        currentDepth = depth;
+    }
+
+private:
+    struct Task {
+        std::function<void()> run;
+        int depth;
+    };
+
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::deque<std::function<void()>> pinned; // only ever run by the owning worker
+        std::atomic<long> pinnedCount{0};
+    };
+
+    static constexpr size_t ANY_WORKER = (size_t)-1;
+
+    // the pool and worker index of the calling thread, if it is a worker
+    static inline thread_local const ThreadPool* currentPool = nullptr;
+    static inline thread_local size_t currentWorker = 0;
+    // the depth of the task the calling thread is running, 0 outside of tasks
+    static inline thread_local int currentDepth = 0;
+
+    void push(std::function<void()> task, const size_t worker) {
+        const size_t target = worker != ANY_WORKER ? worker
+            : currentPool == this ? currentWorker
+            : nextQueue++ % queues.size();
+        {
+            std::lock_guard<std::mutex> lock(queues[target]->mutex);
+            queues[target]->tasks.push_back({std::move(task), currentDepth + 1});
+        }
+        queued.fetch_add(1, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex); // pairs with the check in work()
+        }
+        wakeUp.notify_one();
+    }
+
+    // Runs one queued task of at least minDepth: the newest of the calling worker's own
+    // deque, or else the oldest of another deque. Returns false if there was none.
+    bool runOne(const int minDepth = 0) {
+        const bool isWorker = currentPool == this;
+        const size_t home = isWorker ? currentWorker : 0;
+        Task task{nullptr, 0};
+        bool pinned = false;
+        for (size_t offset = 0; offset < queues.size() && !task.run; offset++) {
+            WorkerQueue& queue = *queues[(home + offset) % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (offset == 0 && isWorker && !queue.pinned.empty()) {
+                task = {std::move(queue.pinned.front()), currentDepth + 1};
+                queue.pinned.pop_front();
+                queue.pinnedCount.fetch_sub(1, std::memory_order_relaxed);
+                pinned = true;
+            } else if (offset == 0 && isWorker) {
+                for (auto newest = queue.tasks.rbegin(); newest != queue.tasks.rend(); ++newest) {
+                    if (newest->depth >= minDepth) {
+                        task = std::move(*newest);
+                        queue.tasks.erase(std::next(newest).base());
+                        break;
+                    }
+                }
+            } else {
+                for (auto oldest = queue.tasks.begin(); oldest != queue.tasks.end(); ++oldest) {
+                    if (oldest->depth >= minDepth) {
+                        task = std::move(*oldest);
+                        queue.tasks.erase(oldest);
+                        break;
+                    }
+                }
+            }
+        }
+        if (!task.run) {
+            return false;
+        }
+        if (!pinned) {
+            queued.fetch_sub(1, std::memory_order_relaxed);
+        }
+        const int outerDepth = currentDepth;
+        currentDepth = task.depth;
+        task.run();
+        currentDepth = outerDepth;
+        return true;
+    }
+
+    void work(const size_t index) {
+        currentPool = this;
+        currentWorker = index;
+        for (;;) {
+            if (runOne()) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wakeUp.wait(lock, [this, index]() {
+                return stopping || queued.load(std::memory_order_acquire) > 0 || queues[index]->pinnedCount.load(std::memory_order_acquire) > 0;
+            });
+            if (stopping && queued.load(std::memory_order_acquire) == 0) {
+                return;
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> nextQueue{0};
+    std::atomic<long> queued{0};
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    bool stopping = false;
+};
+
+// Bounded single-producer, single-consumer ring. Neither side locks to pass values: each
+// owns one index and publishes it with a release store that the other side reads with an
+// acquire load. push() and pop() spin briefly while the ring is full or empty and then
+// sleep on a condition variable, which the other side only locks to wake a sleeper, so an
+// idle side costs nothing. close() ends pop() once the ring is empty.
+template <class T, size_t CAPACITY>
+class SpscQueue {
+public:
+    bool tryPush(T& value) {
+        const size_t tail = tailIndex.load(std::memory_order_relaxed);
+        if (tail - headIndex.load(std::memory_order_acquire) == CAPACITY) {
+            return false;
+        }
+        slots[tail % CAPACITY] = std::move(value);
+        tailIndex.store(tail + 1, std::memory_order_release);
+        wakeSleeper();
+        return true;
+    }
+
+    bool tryPop(T& value) {
+        const size_t head = headIndex.load(std::memory_order_relaxed);
+        if (head == tailIndex.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = std::move(slots[head % CAPACITY]);
+        headIndex.store(head + 1, std::memory_order_release);
+        wakeSleeper();
+        return true;
+    }
+
+    void push(T& value) {
+        for (int spins = 0; !tryPush(value); spins++) {
+            if (spins < SPSC_SPINS) {
+                std::this_thread::yield();
+            } else {
+                sleepUntil([this]() { return tailIndex.load(std::memory_order_acquire) - headIndex.load(std::memory_order_acquire) < CAPACITY; });
+            }
+        }
+    }
+
+    // Waits for a value. Returns false once the ring is closed and empty.
+    bool pop(T& value) {
+        for (int spins = 0; !tryPop(value); spins++) {
+            if (closed.load(std::memory_order_acquire)) {
+                return tryPop(value); // values pushed before close() are visible now
+            }
+            if (spins < SPSC_SPINS) {
+                std::this_thread::yield();
+            } else {
+                sleepUntil([this]() {
+                    return headIndex.load(std::memory_order_acquire) != tailIndex.load(std::memory_order_acquire) || closed.load(std::memory_order_acquire);
+                });
+            }
+        }
+        return true;
+    }
+
+    // Called by the producer after its last push().
+    void close() {
+        closed.store(true, std::memory_order_release);
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        wakeUp.notify_all();
+    }
+
+private:
+    static constexpr int SPSC_SPINS = 64;
+
+    // The sleeper announces itself before it checks the ring and the other side checks for
+    // sleepers after it moved its index; the fences make sure one of them sees the other.
+    template <class Ready>
+    void sleepUntil(Ready ready) {
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleepers.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        wakeUp.wait(lock, ready);
+        sleepers.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void wakeSleeper() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers.load(std::memory_order_relaxed) > 0) {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            wakeUp.notify_all();
+        }
+    }
+
+    std::array<T, CAPACITY> slots;
+    alignas(64) std::atomic<size_t> headIndex{0};
+    alignas(64) std::atomic<size_t> tailIndex{0};
+    alignas(64) std::atomic<int> sleepers{0};
+    std::atomic<bool> closed{false};
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+};
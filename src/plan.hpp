@@ -0,0 +1,176 @@
+/******************************************************************************
+
+Execution planning.
+
+The memory of a run is mostly the strata, eight bytes per value for every
+copy of the design that is alive at once (one for a plain design, two for
+candidates: the one being scored and the best so far), plus the output blocks in flight,
+which depend on the number of workers and output files but not on N. The
+planner estimates the peak for holding the strata in memory and, if that
+exceeds the budget, falls back to computing them on the fly from random-access
+permutations, whose memory does not grow with N at all. Values are computed
+and written block by block in either case, so no matrix of points is ever
+held.
+
+The two strategies give different designs for the same seed, so the choice
+depends only on the design and the budget, measured as if for one worker, and
+never on the number of cores: a command gives the same design on every machine
+or, where its buffers for more workers do not fit the budget, fails.
+
+Times come from the throughput of one core of a current x86 machine and are
+meant as an order of magnitude.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include "design.hpp"
+#include "output.hpp"
+#include "shuffle.hpp"
+
+enum class ExecutionStrategy { InMemory, Implicit };
+
+// single-core throughput, for estimates only
+constexpr double PLAN_STRATA_VALUES_PER_SECOND = 60e6;    // shuffling stored strata
+constexpr double PLAN_FORMAT_VALUES_PER_SECOND = 9e6;     // values from stored strata to CSV text
+constexpr double PLAN_IMPLICIT_VALUES_PER_SECOND = 6.5e6; // the same from random-access permutations
+constexpr double PLAN_GZIP_BYTES_PER_SECOND = 8e6;
+constexpr double PLAN_ZSTD_BYTES_PER_SECOND = 150e6;
+constexpr double PLAN_GZIP_RATIO = 0.42;
+constexpr double PLAN_ZSTD_RATIO = 0.40;
+
+// code, libraries, thread stacks and allocator slack
+constexpr uint64_t PLAN_BASE_BYTES = 8 << 20;
+
+// What a run has to do, as far as memory and time are concerned.
+struct Workload {
+    long rows;
+    int dimensions;
+    double rowBytes;        // estimated width of a CSV row
+    uint64_t headingBytes;
+    double strataCopies;    // design-sized sets of strata alive at once
+    long strataBuilds;      // sets of strata generated (candidates)
+    uint64_t inputBytes;    // input held besides the strata, such as a design to augment
+    long files;             // output files written concurrently
+    uint64_t sharedBytes;   // shared memory the output is published in
+    Compression compression;
+    bool implicitAllowed;   // whether the strata may come from random-access permutations
+};
+
+struct ExecutionPlan {
+    ExecutionStrategy strategy;
+    uint64_t strataBytes;
+    uint64_t bufferBytes;
+    uint64_t peakBytes;
+    uint64_t outputBytes;
+    double seconds;
+};
+
+// Parses a size such as "512M", "4G" or "1.5GiB"; the suffixes are powers of 1024.
+inline uint64_t parseByteSize(const std::string& text) {
+    size_t end = 0;
+    double value;
+    try {
+        value = std::stod(text, &end);
+    } catch (std::exception&) {
+        throw std::invalid_argument("Invalid input. Unknown size: " + text);
+    }
+    std::string unit = text.substr(end);
+    for (char& character : unit) {
+        character = std::toupper((unsigned char)character);
+    }
+    const std::string prefixes = "KMGT";
+    double scale = 1;
+    if (!unit.empty() && prefixes.find(unit[0]) != std::string::npos) {
+        scale = std::pow(1024.0, prefixes.find(unit[0]) + 1);
+        unit = unit.substr(1);
+    }
+    if (!(unit.empty() || unit == "B" || unit == "IB") || !(value > 0)) {
+        throw std::invalid_argument("Invalid input. Unknown size: " + text);
+    }
+    return (uint64_t)(value * scale);
+}
+
+inline std::string formatByteSize(const uint64_t bytes) {
+    const char* units[] = {"B", "KiB", "MiB", "GiB", "TiB", "PiB"};
+    double value = bytes;
+    int unit = 0;
+    while (value >= 1024 && unit < 5) {
+        value /= 1024;
+        unit++;
+    }
+    char text[32];
+    std::snprintf(text, sizeof(text), unit == 0 ? "%.0f %s" : "%.1f %s", value, units[unit]);
+    return text;
+}
+
+inline std::string describeStrategy(const ExecutionStrategy strategy) {
+    return strategy == ExecutionStrategy::InMemory
+        ? "strata in memory, rows streamed in blocks"
+        : "strata computed on the fly from random-access permutations, rows streamed in blocks";
+}
+
+// Output blocks in flight, per-thread scratch and any shared-memory ring, which do not
+// grow with the number of rows beyond the first few blocks.
+inline uint64_t pipelineBytes(const Workload& workload, const size_t workers) {
+    const uint64_t writers = std::min<uint64_t>(workload.files, workers + 1);
+    const bool compressed = workload.compression != Compression::None;
+    uint64_t blocks = 2 * workers + ASYNC_BUFFERS + 1;
+    if (compressed) {
+        blocks += 4 * workers; // blocks being compressed and their results
+    }
+    // a small file has fewer and smaller blocks than that
+    const double fileBytes = ((double)workload.rows * workload.rowBytes + workload.headingBytes) / std::max(1L, workload.files);
+    const uint64_t fileBlocks = std::max(1.0, std::ceil(fileBytes / OUTPUT_BLOCK_SIZE));
+    blocks = std::min<uint64_t>(blocks, (compressed ? 2 : 1) * fileBlocks);
+    const uint64_t blockBytes = std::min<double>(OUTPUT_BLOCK_SIZE, fileBytes + 1);
+    const uint64_t chunkValues = std::min<double>(DESIGN_CHUNK_VALUES, (double)workload.rows * workload.dimensions);
+    // appended strings may have twice the capacity they use
+    return writers * blocks * 2 * blockBytes + (workers + 1) * chunkValues * 2 * sizeof(double) + workload.sharedBytes;
+}
+
+// Picks the strategy for a run and estimates it on the given number of workers. maxMemory
+// 0 means no limit, in which case the strata are always held in memory. The strategy does
+// not depend on workers. Throws if the run does not fit the budget.
+inline ExecutionPlan planExecution(const Workload& workload, const size_t workers, const uint64_t maxMemory) {
+    ExecutionPlan plan;
+    const double values = (double)workload.rows * workload.dimensions;
+    const uint64_t shuffleColumnBytes = workload.rows >= PARALLEL_SHUFFLE_THRESHOLD ? SHUFFLE_SEGMENTS * (1 << SHUFFLE_BUCKET_BITS) * sizeof(long) : 0;
+    const uint64_t strataBytes = (uint64_t)(workload.strataCopies * values * sizeof(long)) + workload.inputBytes;
+
+    const uint64_t oneWorkerPeak = PLAN_BASE_BYTES + strataBytes + shuffleColumnBytes + pipelineBytes(workload, 1);
+    plan.strategy = maxMemory > 0 && oneWorkerPeak > maxMemory && workload.implicitAllowed ? ExecutionStrategy::Implicit : ExecutionStrategy::InMemory;
+
+    plan.bufferBytes = pipelineBytes(workload, workers);
+    plan.strataBytes = plan.strategy == ExecutionStrategy::InMemory
+        ? strataBytes + std::min<uint64_t>(workload.dimensions, workers + 1) * shuffleColumnBytes
+        : 0;
+    plan.peakBytes = PLAN_BASE_BYTES + plan.strataBytes + plan.bufferBytes;
+    if (maxMemory > 0 && plan.peakBytes > maxMemory) {
+        throw std::invalid_argument("Invalid input. The run needs about " + formatByteSize(plan.peakBytes) + " of memory on " + std::to_string(workers) + " worker(s), more than --max-memory " + formatByteSize(maxMemory) + "."
+            + (plan.strategy == ExecutionStrategy::Implicit || !workload.implicitAllowed ? "" : " Strata that fit the budget are always held in memory, so that the design does not depend on the number of workers; raise the budget for the output buffers of this many workers.")
+            + (workload.implicitAllowed ? "" : " Only plain random designs without slices, candidates or augmenting can be generated without holding their strata."));
+    }
+
+    const double textBytes = workload.rows * workload.rowBytes + workload.headingBytes;
+    double seconds = plan.strategy == ExecutionStrategy::InMemory
+        ? workload.strataBuilds * values / PLAN_STRATA_VALUES_PER_SECOND + values / PLAN_FORMAT_VALUES_PER_SECOND
+        : values / PLAN_IMPLICIT_VALUES_PER_SECOND;
+    plan.outputBytes = textBytes;
+    if (workload.compression == Compression::Gzip) {
+        seconds += textBytes / PLAN_GZIP_BYTES_PER_SECOND;
+        plan.outputBytes = textBytes * PLAN_GZIP_RATIO;
+    } else if (workload.compression == Compression::Zstd) {
+        seconds += textBytes / PLAN_ZSTD_BYTES_PER_SECOND;
+        plan.outputBytes = textBytes * PLAN_ZSTD_RATIO;
+    }
+    plan.seconds = seconds / workers;
+    return plan;
+}
@@ -0,0 +1,139 @@
+/******************************************************************************
+
+Progress reports.
+
+A large run can spend minutes building strata, searching candidates or
+writing rows without a word. With --progress, a reporter thread wakes at a
+fixed interval, reads a counter of finished units of the current phase (strata
+values shuffled or placed, or rows committed to the output) and prints the
+percentage, the rate and an estimate of the remaining time, as text or as one
+JSON object per line.
+
+The workers add to the counter once per strata column or output block, with
+relaxed atomics on a cache line of their own, so the cost does not depend on
+the number of points and the reporter never touches the data.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+enum class ProgressFormat { Text, Json };
+
+inline ProgressFormat parseProgressFormat(const std::string& name) {
+    if (name == "text") {
+        return ProgressFormat::Text;
+    }
+    if (name == "json") {
+        return ProgressFormat::Json;
+    }
+    throw std::invalid_argument("Invalid input. Unknown progress format: " + name);
+}
+
+class Progress {
+public:
+    Progress(std::ostream& out, const double intervalSeconds, const ProgressFormat format)
+        : out(out), interval(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(intervalSeconds))), format(format),
+          reporter([this]() { run(); }) {}
+
+    ~Progress() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        reporter.join();
+    }
+
+    // Starts a phase of total units, such as "strata" in values or "rows" in rows; called
+    // between phases, not during one.
+    void phase(const std::string& name, const long total, const std::string& unit) {
+        std::lock_guard<std::mutex> lock(mutex);
+        phaseName = name;
+        phaseUnit = unit;
+        phaseTotal = total;
+        phaseStart = Clock::now();
+        done.store(0, std::memory_order_relaxed);
+        bytes.store(0, std::memory_order_relaxed);
+    }
+
+    // Called by the workers once per finished strata column or output block.
+    void advance(const long units, const uint64_t blockBytes = 0) {
+        done.fetch_add(units, std::memory_order_relaxed);
+        if (blockBytes > 0) {
+            bytes.fetch_add(blockBytes, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            if (wake.wait_for(lock, interval, [this]() { return stopping; })) {
+                return;
+            }
+            if (!phaseName.empty()) {
+                report();
+            }
+        }
+    }
+
+    // Prints one line for the current phase; the mutex is held.
+    void report() {
+        const long units = done.load(std::memory_order_relaxed);
+        const uint64_t written = bytes.load(std::memory_order_relaxed);
+        const double elapsed = std::chrono::duration<double>(Clock::now() - phaseStart).count();
+        const double rate = elapsed > 0 ? units / elapsed : 0;
+        const double percent = phaseTotal > 0 ? 100.0 * units / phaseTotal : 0;
+        const double eta = rate > 0 ? (phaseTotal - units) / rate : -1;
+
+        char line[256];
+        if (format == ProgressFormat::Json) {
+            char etaText[32] = "null";
+            if (eta >= 0) {
+                std::snprintf(etaText, sizeof(etaText), "%.3f", eta);
+            }
+            std::snprintf(line, sizeof(line), "{\"phase\":\"%s\",\"unit\":\"%s\",\"done\":%ld,\"total\":%ld,\"percent\":%.2f,\"elapsed\":%.3f,\"rate\":%.1f,\"bytes\":%llu,\"eta\":%s}\n",
+                phaseName.c_str(), phaseUnit.c_str(), units, phaseTotal, percent, elapsed, rate, (unsigned long long)written, etaText);
+        } else {
+            char etaText[32] = "unknown";
+            if (eta >= 0) {
+                std::snprintf(etaText, sizeof(etaText), "%.1f s", eta);
+            }
+            char bytesText[32] = "";
+            if (written > 0) {
+                std::snprintf(bytesText, sizeof(bytesText), ", %.1f MiB/s", elapsed > 0 ? written / elapsed / (1 << 20) : 0.0);
+            }
+            std::snprintf(line, sizeof(line), "Progress: %s %.1f%% (%ld of %ld), %.0f %s/s%s, ETA %s\n",
+                phaseName.c_str(), percent, units, phaseTotal, rate, phaseUnit.c_str(), bytesText, etaText);
+        }
+        out << line << std::flush;
+    }
+
+    std::ostream& out;
+    const Clock::duration interval;
+    const ProgressFormat format;
+
+    alignas(64) std::atomic<long> done{0};
+    std::atomic<uint64_t> bytes{0};
+    alignas(64) std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::string phaseName;
+    std::string phaseUnit;
+    long phaseTotal = 0;
+    Clock::time_point phaseStart = Clock::now();
+    std::thread reporter;
+};
@@ -0,0 +1,192 @@
+/******************************************************************************
+
+Shared-memory ring output.
+
+A pipe copies every block into the kernel and out again. For a consumer on the
+same machine, --out-path shm:/name publishes the blocks in a POSIX
+shared-memory segment instead: a header and a fixed number of slots, each big
+enough for an output block, used in turn. The consumer reads the blocks where
+they are and releases their slots, and lhc waits only when every slot holds a
+block the consumer has not released. The layout and the consumer side are in
+include/lhc_ring.h, which C programs include directly.
+
+Blocks are formatted concurrently into buffers of their own and committed in
+row order (see writeDesign()), so each block is copied once into its slot, on
+the I/O thread of the AsyncSink in front of this sink.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <csignal>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "lhc_ring.h"
+#include "output.hpp"
+#include "parallel.hpp"
+
+const std::string SHM_PATH_PREFIX = "shm:";
+
+// How long lhc waits, with every slot full, for a consumer to open the ring.
+constexpr int RING_ATTACH_TIMEOUT_SECONDS = 60;
+
+// Bytes per slot, including its lhc_ring_slot: twice the usual block, so that uncompressed
+// blocks, whose size is only estimated, fit, and at least two rows of rowBytes, so that a
+// block of a single wide row does too.
+inline size_t ringSlotBytes(const size_t rowBytes) {
+    return sizeof(lhc_ring_slot) + std::max<size_t>(2 * OUTPUT_BLOCK_SIZE, (2 * rowBytes + 63) / 64 * 64);
+}
+
+inline bool isShmPath(const std::string& path) {
+    return path.compare(0, SHM_PATH_PREFIX.size(), SHM_PATH_PREFIX) == 0;
+}
+
+// "shm:/lhc-ring" or "shm:lhc-ring" -> "/lhc-ring".
+inline std::string shmName(const std::string& path) {
+    std::string name = path.substr(SHM_PATH_PREFIX.size());
+    if (name.empty() || name.find('/', 1) != std::string::npos || name == "/") {
+        throw std::invalid_argument("Invalid input. A shared-memory output needs a name without further slashes, such as shm:/lhc-ring: " + path);
+    }
+    return name[0] == '/' ? name : "/" + name;
+}
+
+// Publishes blocks to a shared-memory ring created under the given name, replacing any
+// stale segment of that name. Slots are sized by ringSlotBytes() from the width of a row,
+// exact for binary output and estimated by rowWidth() for CSV. A block larger than a slot
+// is cut at the last whole row that fits (a CSV line, or a binary row); compressed output,
+// and a CSV line longer than the estimate that fills a slot on its own, are cut where the
+// slot is full and the slot marked LHC_RING_SLOT_CONTINUED. Throws if the consumer closes
+// the ring before the design is complete, exits while the ring is full, or has not opened
+// it RING_ATTACH_TIMEOUT_SECONDS after it filled up. A ring destroyed before finish() is
+// marked failed, so the consumer does not take a partial design for a whole one, and its
+// name is removed if no consumer opened it; if the process ends without unwinding, the
+// consumer notices that it is gone.
+class SharedRingSink : public OutputSink {
+public:
+    SharedRingSink(const std::string& name, const uint32_t slots, const bool binary, const bool compressed, const uint64_t dimensions, const uint64_t rows, const size_t csvRowBytes)
+        : name(name), binary(binary), compressed(compressed), rowBytes(dimensions * sizeof(double)),
+          slotBytes(ringSlotBytes(binary ? rowBytes : csvRowBytes)) {
+        ::shm_unlink(name.c_str());
+        const int descriptor = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (descriptor < 0) {
+            throw std::runtime_error("Failed to create shared memory " + name + ": " + std::strerror(errno));
+        }
+        size = sizeof(lhc_ring_header) + slots * slotBytes;
+        if (::ftruncate(descriptor, size) != 0) {
+            const int error = errno;
+            ::close(descriptor);
+            ::shm_unlink(name.c_str());
+            throw std::runtime_error("Failed to size shared memory " + name + ": " + std::strerror(error));
+        }
+        void* address = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+        const int error = errno;
+        ::close(descriptor);
+        if (address == MAP_FAILED) {
+            ::shm_unlink(name.c_str());
+            throw std::runtime_error("Failed to map shared memory " + name + ": " + std::strerror(error));
+        }
+
+        ring.header = (lhc_ring_header*)address;
+        ring.size = size;
+        lhc_ring_header& header = *ring.header;
+        header.version = LHC_RING_VERSION;
+        header.slot_count = slots;
+        header.slot_size = slotBytes;
+        header.segment_size = size;
+        header.format = binary ? LHC_RING_BINARY : LHC_RING_CSV;
+        header.compressed = compressed;
+        header.dimensions = dimensions;
+        header.rows = rows;
+        header.producer_pid = ::getpid();
+        __atomic_store_n(&header.magic, LHC_RING_MAGIC, __ATOMIC_RELEASE);
+    }
+
+    ~SharedRingSink() override {
+        if (!finished) {
+            __atomic_store_n(&ring.header->state, LHC_RING_FAILED, __ATOMIC_RELEASE);
+            if (__atomic_load_n(&ring.header->consumer_pid, __ATOMIC_ACQUIRE) == 0) {
+                ::shm_unlink(name.c_str()); // nobody will open it now
+            }
+        }
+        ::munmap(ring.header, size);
+    }
+
+    void write(std::string& block) override {
+        const size_t capacity = slotBytes - sizeof(lhc_ring_slot);
+        size_t offset = 0;
+        while (offset < block.size()) {
+            size_t length = std::min(capacity, block.size() - offset);
+            bool continued = false;
+            if (offset + length < block.size()) {
+                if (binary && !compressed) {
+                    length = length / rowBytes * rowBytes; // a slot holds at least one row
+                } else if (!compressed) {
+                    const size_t newline = block.rfind('\n', offset + length - 1);
+                    if (newline != std::string::npos && newline >= offset) {
+                        length = newline + 1 - offset;
+                    } else {
+                        continued = true;
+                    }
+                } else {
+                    continued = true;
+                }
+            }
+            lhc_ring_slot* slot = acquireSlot();
+            std::memcpy(slot + 1, block.data() + offset, length);
+            slot->length = length;
+            slot->flags = continued ? LHC_RING_SLOT_CONTINUED : 0;
+            __atomic_store_n(&ring.header->head, head + 1, __ATOMIC_RELEASE);
+            head++;
+            offset += length;
+        }
+    }
+
+    void finish() override {
+        __atomic_store_n(&ring.header->state, LHC_RING_FINISHED, __ATOMIC_RELEASE);
+        finished = true;
+    }
+
+private:
+    // Waits until the consumer has released the slot the next block goes to. Whether the
+    // consumer is still there is checked every 64 pauses, every few milliseconds once the
+    // wait sleeps.
+    lhc_ring_slot* acquireSlot() {
+        const auto start = std::chrono::steady_clock::now();
+        long pauses = 0;
+        for (Backoff backoff; head - __atomic_load_n(&ring.header->tail, __ATOMIC_ACQUIRE) >= ring.header->slot_count; backoff.pause(), pauses++) {
+            if (__atomic_load_n(&ring.header->reader_closed, __ATOMIC_ACQUIRE)) {
+                throw std::runtime_error("The consumer closed shared memory " + name + " before the design was complete");
+            }
+            if (pauses % 64 != 63) {
+                continue;
+            }
+            const pid_t consumer = __atomic_load_n(&ring.header->consumer_pid, __ATOMIC_ACQUIRE);
+            if (consumer == 0 && std::chrono::steady_clock::now() - start >= std::chrono::seconds(RING_ATTACH_TIMEOUT_SECONDS)) {
+                throw std::runtime_error("No consumer opened shared memory " + name + " within " + std::to_string(RING_ATTACH_TIMEOUT_SECONDS) + " seconds");
+            }
+            if (consumer != 0 && ::kill(consumer, 0) != 0 && errno == ESRCH) {
+                throw std::runtime_error("The consumer of shared memory " + name + " exited before the design was complete");
+            }
+        }
+        return lhc_ring_slot_at(&ring, head);
+    }
+
+    const std::string name;
+    const bool binary;
+    const bool compressed;
+    const size_t rowBytes;
+    const size_t slotBytes;
+    size_t size;
+    lhc_ring ring;
+    uint64_t head = 0;
+    bool finished = false;
+};
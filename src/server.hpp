@@ -0,0 +1,361 @@
+/******************************************************************************
+
+Design server.
+
+`lhc serve` keeps one process with a warm thread pool listening on a Unix
+domain socket, so that clients asking for many small designs pay neither
+process start-up nor the creation of threads and buffers for each one.
+
+Every connection is served by its own thread and may send any number of
+requests, one at a time. All integers are in the host's byte order, since both
+ends run on the same machine.
+
+    request:  magic "LHC1" (4 bytes), type (1 byte), payload length (u32),
+              payload
+    response: magic "LHC1" (4 bytes), status (1 byte), message length (u32),
+              data length (u64), message, data
+
+A design request carries the lhc arguments as NUL-terminated strings and is
+answered with the design, as CSV or, with --format binary, as raw doubles. The
+status is 0 on success; otherwise the message holds the error. A stats request
+is answered with counters and a histogram of request latencies (see
+ServerStats), and a stop request shuts the server down once the requests in
+progress are answered.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+constexpr char SERVER_MAGIC[4] = {'L', 'H', 'C', '1'};
+constexpr size_t SERVER_REQUEST_HEADER = 9;
+constexpr size_t SERVER_RESPONSE_HEADER = 17;
+constexpr uint32_t SERVER_MAX_REQUEST = 1 << 20;
+
+// Latency histogram buckets: bucket i counts requests that took [2^i, 2^(i+1)) microseconds.
+constexpr int SERVER_LATENCY_BUCKETS = 32;
+
+enum class RequestType : uint8_t { Design = 1, Stats = 2, Stop = 3 };
+
+// Counters of a running server, updated with relaxed atomics by the connection threads.
+// Sent in answer to a stats request as: requests, failed requests, data bytes sent,
+// connections accepted, uptime in microseconds (all u64), the number of latency buckets
+// (u32) and the bucket counts (u64 each).
+struct ServerStats {
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> failures{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> connections{0};
+    std::atomic<uint64_t> latency[SERVER_LATENCY_BUCKETS] = {};
+    const std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+    void record(const uint64_t micros) {
+        int bucket = 0;
+        while (bucket < SERVER_LATENCY_BUCKETS - 1 && (micros >> (bucket + 1)) > 0) {
+            bucket++;
+        }
+        latency[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::string serialise() const {
+        std::string bytes;
+        auto append = [&bytes](const auto value) {
+            bytes.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        };
+        append((uint64_t)requests.load(std::memory_order_relaxed));
+        append((uint64_t)failures.load(std::memory_order_relaxed));
+        append((uint64_t)this->bytes.load(std::memory_order_relaxed));
+        append((uint64_t)connections.load(std::memory_order_relaxed));
+        append((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count());
+        append((uint32_t)SERVER_LATENCY_BUCKETS);
+        for (const std::atomic<uint64_t>& count : latency) {
+            append((uint64_t)count.load(std::memory_order_relaxed));
+        }
+        return bytes;
+    }
+};
+
+// Reads exactly length bytes; false if the peer closed the connection first.
+inline bool readFully(const int descriptor, char* data, size_t length) {
+    while (length > 0) {
+        const ssize_t received = ::recv(descriptor, data, length, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        data += received;
+        length -= received;
+    }
+    return true;
+}
+
+// Writes exactly length bytes; false if the peer has gone away.
+inline bool writeFully(const int descriptor, const char* data, size_t length) {
+    while (length > 0) {
+        const ssize_t sent = ::send(descriptor, data, length, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+inline sockaddr_un socketAddress(const std::string& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("Invalid input. Socket path must have between 1 and " + std::to_string(sizeof(address.sun_path) - 1) + " characters.");
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+// Connects to a server; returns the descriptor.
+inline int connectSocket(const std::string& path) {
+    const sockaddr_un address = socketAddress(path);
+    const int descriptor = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (descriptor < 0) {
+        throw std::runtime_error(std::string("Failed to create a socket: ") + std::strerror(errno));
+    }
+    if (::connect(descriptor, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        const int error = errno;
+        ::close(descriptor);
+        throw std::runtime_error("Failed to connect to " + path + ": " + std::strerror(error));
+    }
+    return descriptor;
+}
+
+inline void sendRequest(const int descriptor, const RequestType type, const std::string& payload) {
+    char header[SERVER_REQUEST_HEADER];
+    const uint32_t length = payload.size();
+    std::memcpy(header, SERVER_MAGIC, 4);
+    header[4] = (char)type;
+    std::memcpy(header + 5, &length, 4);
+    if (!writeFully(descriptor, header, sizeof(header)) || !writeFully(descriptor, payload.data(), payload.size())) {
+        throw std::runtime_error("Failed to send a request: the server closed the connection");
+    }
+}
+
+// Receives a response into message and data, which keep their capacity across calls.
+// Returns the status.
+inline int receiveResponse(const int descriptor, std::string& message, std::string& data) {
+    char header[SERVER_RESPONSE_HEADER];
+    if (!readFully(descriptor, header, sizeof(header)) || std::memcmp(header, SERVER_MAGIC, 4) != 0) {
+        throw std::runtime_error("Failed to receive a response: the server closed the connection");
+    }
+    uint32_t messageLength;
+    uint64_t dataLength;
+    std::memcpy(&messageLength, header + 5, 4);
+    std::memcpy(&dataLength, header + 9, 8);
+    message.resize(messageLength);
+    data.resize(dataLength);
+    if (!readFully(descriptor, &message[0], messageLength) || !readFully(descriptor, &data[0], dataLength)) {
+        throw std::runtime_error("Failed to receive a response: the server closed the connection");
+    }
+    return (unsigned char)header[4];
+}
+
+// Encodes arguments as a design request payload.
+inline std::string encodeArguments(const std::vector<std::string>& arguments) {
+    std::string payload;
+    for (const std::string& argument : arguments) {
+        payload += argument;
+        payload += '\0';
+    }
+    return payload;
+}
+
+// Runs a design request: fills data with the design and message with an error or other
+// output, and returns 0 on success.
+using DesignHandler = std::function<int(const std::vector<std::string>& arguments, std::string& data, std::string& message)>;
+
+// Listens on a Unix domain socket until a stop request arrives.
+class DesignServer {
+public:
+    DesignServer(const std::string& path, DesignHandler handler) : path(path), handler(std::move(handler)) {
+        const sockaddr_un address = socketAddress(path);
+
+        // a socket file nobody answers on is left over from a server that died; replace it
+        try {
+            ::close(connectSocket(path));
+            throw std::invalid_argument("Invalid input. A server is already listening on " + path);
+        } catch (std::runtime_error&) {
+            ::unlink(path.c_str());
+        }
+
+        listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listener < 0 || ::bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listener, SOMAXCONN) != 0) {
+            const int error = errno;
+            if (listener >= 0) {
+                ::close(listener);
+            }
+            throw std::runtime_error("Failed to listen on " + path + ": " + std::strerror(error));
+        }
+    }
+
+    ~DesignServer() {
+        ::close(listener);
+        ::unlink(path.c_str());
+    }
+
+    DesignServer(const DesignServer&) = delete;
+    DesignServer& operator=(const DesignServer&) = delete;
+
+    // Accepts connections until a stop request, then waits for the open connections to
+    // finish their current request.
+    void run() {
+        for (;;) {
+            const int connection = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if (stopping.load(std::memory_order_acquire)) {
+                if (connection >= 0) {
+                    ::close(connection);
+                }
+                break;
+            }
+            if (connection < 0) {
+                if (errno == EINTR || errno == ECONNABORTED || errno == EMFILE || errno == ENFILE) {
+                    continue;
+                }
+                throw std::runtime_error(std::string("Failed to accept a connection: ") + std::strerror(errno));
+            }
+            stats.connections.fetch_add(1, std::memory_order_relaxed);
+            {
+                std::lock_guard<std::mutex> lock(connectionsMutex);
+                open.insert(connection);
+            }
+            std::thread([this, connection]() { serve(connection); }).detach();
+        }
+
+        // idle connections are waiting for a request header; wake them up
+        std::unique_lock<std::mutex> lock(connectionsMutex);
+        for (const int connection : open) {
+            ::shutdown(connection, SHUT_RD);
+        }
+        closed.wait(lock, [this]() { return open.empty(); });
+    }
+
+    ServerStats stats;
+
+private:
+    void serve(const int connection) {
+        std::string payload;
+        std::string message;
+        std::string data; // the response buffer, reused by every request of the connection
+        for (;;) {
+            char header[SERVER_REQUEST_HEADER];
+            if (!readFully(connection, header, sizeof(header)) || std::memcmp(header, SERVER_MAGIC, 4) != 0) {
+                break;
+            }
+            const RequestType type = (RequestType)header[4];
+            uint32_t length;
+            std::memcpy(&length, header + 5, 4);
+            if (length > SERVER_MAX_REQUEST) {
+                break;
+            }
+            payload.resize(length);
+            if (!readFully(connection, &payload[0], length)) {
+                break;
+            }
+
+            const auto started = std::chrono::steady_clock::now();
+            message.clear();
+            data.clear();
+            int status = 0;
+            if (type == RequestType::Design) {
+                std::vector<std::string> arguments{"lhc"};
+                for (size_t start = 0; start < payload.size();) {
+                    size_t end = payload.find('\0', start);
+                    end = end == std::string::npos ? payload.size() : end;
+                    arguments.push_back(payload.substr(start, end - start));
+                    start = end + 1;
+                }
+                try {
+                    status = handler(arguments, data, message);
+                } catch (std::exception& e) {
+                    status = 1;
+                    message = std::string(e.what()) + "\n";
+                }
+                if (status != 0) {
+                    data.clear();
+                }
+            } else if (type == RequestType::Stats) {
+                data = stats.serialise();
+            } else if (type == RequestType::Stop) {
+                message = "Stopping";
+            } else {
+                status = 1;
+                message = "Unknown request type " + std::to_string((int)type) + "\n";
+            }
+
+            if (!respond(connection, status, message, data)) {
+                break;
+            }
+            if (type == RequestType::Design) {
+                stats.requests.fetch_add(1, std::memory_order_relaxed);
+                stats.failures.fetch_add(status != 0, std::memory_order_relaxed);
+                stats.bytes.fetch_add(data.size(), std::memory_order_relaxed);
+                stats.record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count());
+            }
+            if (type == RequestType::Stop) {
+                stopping.store(true, std::memory_order_release);
+                ::shutdown(listener, SHUT_RDWR); // wakes up accept()
+                break;
+            }
+        }
+
+        // forget the connection before closing it: once it is closed, accept() may hand out
+        // its number to a new connection, whose entry this must not erase. The server may be
+        // destroyed as soon as the lock is released, so nothing after that touches it.
+        {
+            std::lock_guard<std::mutex> lock(connectionsMutex);
+            open.erase(connection);
+            closed.notify_all();
+        }
+        ::close(connection);
+    }
+
+    static bool respond(const int connection, const int status, const std::string& message, const std::string& data) {
+        char header[SERVER_RESPONSE_HEADER];
+        const uint32_t messageLength = message.size();
+        const uint64_t dataLength = data.size();
+        std::memcpy(header, SERVER_MAGIC, 4);
+        header[4] = (char)status;
+        std::memcpy(header + 5, &messageLength, 4);
+        std::memcpy(header + 9, &dataLength, 8);
+        return writeFully(connection, header, sizeof(header))
+            && writeFully(connection, message.data(), message.size())
+            && writeFully(connection, data.data(), data.size());
+    }
+
+    const std::string path;
+    const DesignHandler handler;
+    int listener = -1;
+    std::atomic<bool> stopping{false};
+    std::mutex connectionsMutex;
+    std::condition_variable closed;
+    std::set<int> open;
+};
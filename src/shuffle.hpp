@@ -0,0 +1,151 @@
+/******************************************************************************
+
+Random permutations of a single column.
+
+Fisher-Yates is inherently serial and, on a column much larger than the
+cache, every swap is a cache miss. Large columns are therefore shuffled with
+the Rao-Sandelius method: every element is sent to one of a fixed number of
+buckets uniformly at random, and each bucket is then shuffled on its own.
+Bucket sizes and contents are random in exactly the way that makes the
+concatenation a uniformly random permutation.
+
+The column is cut into a fixed number of segments whose bucket draws come from
+generators seeded by (seed, segment). One pass counts the draws, the counts
+give every segment its write position in every bucket, and a second pass
+draws the same values again and scatters the elements. Buckets are then
+shuffled with generators seeded by (seed, bucket). Segments and buckets are
+tasks on the pool, and since their number does not depend on the pool, the
+permutation depends only on the seed.
+
+Designs too large for their strata to be held in memory use random-access
+permutations instead: a keyed Feistel network is a bijection on 2^2k values,
+and cycle walking (applying it again until the result is below n) restricts it
+to a bijection on 0..n-1. Any element can be computed on its own in constant
+memory, at the cost of a few hashes per element.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <vector>
+#include "parallel.hpp"
+
+// Columns shorter than this are shuffled with Fisher-Yates.
+constexpr long PARALLEL_SHUFFLE_THRESHOLD = 1 << 22;
+constexpr int SHUFFLE_BUCKET_BITS = 10;
+constexpr long SHUFFLE_SEGMENTS = 256;
+
+// Fills column with a uniformly random permutation of 0..n-1, determined by the seed.
+inline void randomPermutation(std::vector<long>& column, const long n, const unsigned int seed, ThreadPool& pool) {
+    column.resize(n);
+    if (n < PARALLEL_SHUFFLE_THRESHOLD) {
+        std::seed_seq columnSeed{ seed };
+        std::mt19937 generator (columnSeed);
+        std::iota(column.begin(), column.end(), 0);
+        std::shuffle(column.begin(), column.end(), generator);
+        return;
+    }
+
+    const long buckets = 1L << SHUFFLE_BUCKET_BITS;
+    const int shift = 32 - SHUFFLE_BUCKET_BITS; // the top bits of a 32-bit draw pick the bucket
+    auto segmentGenerator = [seed](const long segment) {
+        std::seed_seq segmentSeed{ seed, 0u, (unsigned int)segment };
+        return std::mt19937(segmentSeed);
+    };
+
+    // counts[segment * buckets + bucket], then the segment's write position in that bucket
+    std::vector<long> counts(SHUFFLE_SEGMENTS * buckets);
+    pool.forEach(SHUFFLE_SEGMENTS, [&](const long segment) {
+        std::mt19937 generator = segmentGenerator(segment);
+        long* segmentCounts = &counts[segment * buckets];
+        for (long index = n * segment / SHUFFLE_SEGMENTS; index < n * (segment + 1) / SHUFFLE_SEGMENTS; index++) {
+            segmentCounts[generator() >> shift]++;
+        }
+    });
+
+    std::vector<long> bucketStart(buckets + 1);
+    long position = 0;
+    for (long bucket = 0; bucket < buckets; bucket++) {
+        bucketStart[bucket] = position;
+        for (long segment = 0; segment < SHUFFLE_SEGMENTS; segment++) {
+            const long count = counts[segment * buckets + bucket];
+            counts[segment * buckets + bucket] = position;
+            position += count;
+        }
+    }
+    bucketStart[buckets] = n;
+
+    pool.forEach(SHUFFLE_SEGMENTS, [&](const long segment) {
+        std::mt19937 generator = segmentGenerator(segment);
+        long* writePositions = &counts[segment * buckets];
+        for (long index = n * segment / SHUFFLE_SEGMENTS; index < n * (segment + 1) / SHUFFLE_SEGMENTS; index++) {
+            column[writePositions[generator() >> shift]++] = index;
+        }
+    });
+
+    pool.forEach(buckets, [&](const long bucket) {
+        std::seed_seq bucketSeed{ seed, 1u, (unsigned int)bucket };
+        std::mt19937 generator (bucketSeed);
+        std::shuffle(column.begin() + bucketStart[bucket], column.begin() + bucketStart[bucket + 1], generator);
+    });
+}
+
+constexpr int FEISTEL_ROUNDS = 6;
+
+// A pseudo-random permutation of 0..n-1 that maps any index on demand, determined by the seed.
+class RandomAccessPermutation {
+public:
+    RandomAccessPermutation(const long n, const unsigned int seed) : n(n) {
+        while ((1L << (2 * halfBits)) < n) {
+            halfBits++;
+        }
+        halfMask = (uint64_t(1) << halfBits) - 1;
+        std::seed_seq keySeed{ seed, 2u };
+        std::mt19937_64 generator (keySeed);
+        for (uint64_t& key : keys) {
+            key = generator();
+        }
+    }
+
+    long size() const {
+        return n;
+    }
+
+    // The domain is less than 4n, so on average fewer than four passes are needed.
+    long operator()(const long index) const {
+        uint64_t value = index;
+        do {
+            value = encrypt(value);
+        } while (value >= (uint64_t)n);
+        return value;
+    }
+
+private:
+    uint64_t encrypt(const uint64_t value) const {
+        uint64_t left = value >> halfBits;
+        uint64_t right = value & halfMask;
+        for (const uint64_t key : keys) {
+            const uint64_t mixed = left ^ (mix(right ^ key) & halfMask);
+            left = right;
+            right = mixed;
+        }
+        return (left << halfBits) | right;
+    }
+
+    // the splitmix64 finaliser
+    static uint64_t mix(uint64_t value) {
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+        return value ^ (value >> 31);
+    }
+
+    long n;
+    int halfBits = 0;
+    uint64_t halfMask = 0;
+    std::array<uint64_t, FEISTEL_ROUNDS> keys;
+};
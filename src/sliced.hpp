@@ -0,0 +1,55 @@
+/******************************************************************************
+
+Sliced Latin hypercube designs (Qian, 2012).
+
+A design of N = t * m points is split into t slices of m points. Every slice is
+a Latin hypercube on the coarse m-level grid, and the union of all slices is a
+Latin hypercube on the fine N-level grid: in each dimension, the t fine strata
+that make up coarse stratum j are dealt out one to each slice.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <vector>
+
+// Deals the fine strata of every coarse stratum out to the slices. Entry
+// [dimension][j * slices + k] is the offset within coarse stratum j that slice k receives.
+inline std::vector<std::vector<long>> dealSlices(
+    const long numberOfPoints,
+    const int numberOfDimensions,
+    const long slices,
+    std::mt19937& generator
+) {
+    std::vector<std::vector<long>> dealt(numberOfDimensions, std::vector<long>(numberOfPoints));
+    for (std::vector<long>& column : dealt) {
+        for (long coarse = 0; coarse < numberOfPoints; coarse += slices) {
+            std::iota(column.begin() + coarse, column.begin() + coarse + slices, 0);
+            std::shuffle(column.begin() + coarse, column.begin() + coarse + slices, generator);
+        }
+    }
+    return dealt;
+}
+
+// Returns the fine strata of one slice, one column per dimension, in a random row order.
+inline std::vector<std::vector<long>> sliceStrata(
+    const std::vector<std::vector<long>>& dealt,
+    const long slices,
+    const long slice,
+    std::mt19937& generator
+) {
+    const long pointsPerSlice = dealt.empty() ? 0 : dealt[0].size() / slices;
+    std::vector<std::vector<long>> strata(dealt.size(), std::vector<long>(pointsPerSlice));
+    for (size_t dimensionIndex = 0; dimensionIndex < dealt.size(); dimensionIndex++) {
+        std::vector<long>& column = strata[dimensionIndex];
+        std::iota(column.begin(), column.end(), 0);
+        std::shuffle(column.begin(), column.end(), generator);
+        for (long& coarse : column) {
+            coarse = coarse * slices + dealt[dimensionIndex][coarse * slices + slice];
+        }
+    }
+    return strata;
+}
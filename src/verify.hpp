@@ -0,0 +1,314 @@
+/******************************************************************************
+
+Latin hypercube verification.
+
+Checks that a design file has exactly one point in every stratum of every
+dimension. The files are memory mapped and cut into chunks at row boundaries.
+A first pass counts the rows of every chunk, which gives N and the first row
+number of each chunk. A second pass maps every value to its stratum and marks
+it in one bitset per dimension with an atomic OR, so the chunks are checked
+concurrently and the whole check needs N * D / 8 bytes besides the mapping.
+
+Values are assigned to strata with a tolerance of half a unit in the last
+printed digit (at most 0.005 of a stratum), so grid values that were rounded
+down when printed still land in their own stratum.
+
+*******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+#include "mapped_file.hpp"
+#include "parallel.hpp"
+
+constexpr size_t VERIFY_CHUNK_SIZE = 4 << 20;
+constexpr double VERIFY_TOLERANCE = 0.005;
+constexpr int VERIFY_PREFETCH_BATCH = 64;
+
+struct Violation {
+    long row;           // 0-based data row, counted across all files
+    int dimension;      // -1 for a malformed row
+    double value;
+    std::string problem;
+};
+
+struct VerifyReport {
+    long rows = 0;
+    int dimensions = 0;
+    long outOfRange = 0;
+    long duplicates = 0;
+    long malformed = 0;
+    std::vector<long> missing;      // strata without a point, per dimension
+    std::vector<Violation> first;   // the earliest violations by row
+
+    bool valid() const {
+        return outOfRange == 0 && duplicates == 0 && malformed == 0
+            && std::all_of(missing.begin(), missing.end(), [](const long count) { return count == 0; });
+    }
+};
+
+inline bool violationBefore(const Violation& a, const Violation& b) {
+    return a.row != b.row ? a.row < b.row : a.dimension < b.dimension;
+}
+
+// A part of one file that starts and ends on a row boundary.
+struct VerifyChunk {
+    const MappedFile* file;
+    size_t begin;
+    size_t end;
+    bool binary;
+    long firstRow = 0;
+    long rows = 0;
+};
+
+inline bool isBinaryDesign(const std::string& path) {
+    return path.size() > 4 && path.compare(path.size() - 4, 4, ".bin") == 0;
+}
+
+// Calls line(begin, end) for every non-empty line of text in [begin, end).
+template <class Line>
+void forEachLine(const char* begin, const char* const end, Line line) {
+    while (begin < end) {
+        const char* newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+        const char* lineEnd = newline == nullptr ? end : newline;
+        const char* trimmed = lineEnd > begin && lineEnd[-1] == '\r' ? lineEnd - 1 : lineEnd;
+        if (trimmed > begin) {
+            line(begin, trimmed);
+        }
+        begin = newline == nullptr ? end : newline + 1;
+    }
+}
+
+// Splits mapped files into chunks of about VERIFY_CHUNK_SIZE bytes. CSV chunks end after a
+// newline and skip the heading line of each file; binary chunks hold whole rows.
+inline std::vector<VerifyChunk> chunkDesignFiles(const std::vector<std::unique_ptr<MappedFile>>& files, const std::vector<bool>& binary, const int dimensions) {
+    std::vector<VerifyChunk> chunks;
+    for (size_t fileIndex = 0; fileIndex < files.size(); fileIndex++) {
+        const MappedFile& file = *files[fileIndex];
+        size_t position = 0;
+        if (binary[fileIndex]) {
+            const size_t rowBytes = dimensions * sizeof(double);
+            if (file.size() % rowBytes != 0) {
+                throw std::invalid_argument("Invalid input. Binary design size is not a whole number of " + std::to_string(dimensions) + "-dimensional rows.");
+            }
+            const size_t chunkBytes = std::max<size_t>(1, VERIFY_CHUNK_SIZE / rowBytes) * rowBytes;
+            for (; position < file.size(); position += chunkBytes) {
+                chunks.push_back({&file, position, std::min(file.size(), position + chunkBytes), true});
+            }
+            continue;
+        }
+
+        // a first line that does not start like a number is the heading
+        const char* data = file.data();
+        if (file.size() > 0 && !(std::isdigit((unsigned char)data[0]) || data[0] == '-' || data[0] == '+' || data[0] == '.')) {
+            const char* newline = static_cast<const char*>(std::memchr(data, '\n', file.size()));
+            position = newline == nullptr ? file.size() : newline - data + 1;
+        }
+        while (position < file.size()) {
+            size_t end = std::min(file.size(), position + VERIFY_CHUNK_SIZE);
+            const char* newline = end < file.size() ? static_cast<const char*>(std::memchr(data + end, '\n', file.size() - end)) : nullptr;
+            end = newline == nullptr ? file.size() : newline - data + 1;
+            chunks.push_back({&file, position, end, false});
+            position = end;
+        }
+    }
+    return chunks;
+}
+
+// Verifies the concatenation of the given design files. dimensions may be 0 for CSV
+// files, in which case it is taken from the first row. Dimensions beyond the end of scales
+// use defaultScale.
+inline VerifyReport verifyDesign(
+    const std::vector<std::string>& paths,
+    int dimensions,
+    std::vector<std::array<double, 2>> scales,
+    const std::array<double, 2> defaultScale,
+    const size_t maxViolations
+) {
+    std::vector<std::unique_ptr<MappedFile>> files;
+    std::vector<bool> binary;
+    for (const std::string& path : paths) {
+        files.push_back(std::make_unique<MappedFile>(path));
+        binary.push_back(isBinaryDesign(path));
+        if (binary.back() && dimensions <= 0) {
+            throw std::invalid_argument("Invalid input. Binary designs need the number of dimensions.");
+        }
+    }
+
+    std::vector<VerifyChunk> chunks = chunkDesignFiles(files, binary, dimensions);
+    if (dimensions <= 0) {
+        for (const VerifyChunk& chunk : chunks) {
+            const char* begin = chunk.file->data() + chunk.begin;
+            const char* end = chunk.file->data() + chunk.end;
+            forEachLine(begin, end, [&](const char* lineBegin, const char* lineEnd) {
+                if (dimensions <= 0) {
+                    dimensions = std::count(lineBegin, lineEnd, ',') + 1;
+                }
+            });
+            if (dimensions > 0) {
+                break;
+            }
+        }
+        dimensions = std::max(dimensions, 1);
+    }
+    if ((int)scales.size() > dimensions) {
+        throw std::invalid_argument("Invalid dimension index in --scales: " + std::to_string(scales.size() - 1));
+    }
+    scales.resize(dimensions, defaultScale);
+
+    // first pass: rows per chunk
+    parallelFor(chunks.size(), [&](const long chunkIndex) {
+        VerifyChunk& chunk = chunks[chunkIndex];
+        if (chunk.binary) {
+            chunk.rows = (chunk.end - chunk.begin) / (dimensions * sizeof(double));
+            return;
+        }
+        long rows = 0;
+        forEachLine(chunk.file->data() + chunk.begin, chunk.file->data() + chunk.end, [&](const char*, const char*) { rows++; });
+        chunk.rows = rows;
+    });
+    long totalRows = 0;
+    for (VerifyChunk& chunk : chunks) {
+        chunk.firstRow = totalRows;
+        totalRows += chunk.rows;
+    }
+
+    VerifyReport report;
+    report.rows = totalRows;
+    report.dimensions = dimensions;
+    if (totalRows == 0) {
+        report.missing.assign(dimensions, 0);
+        return report;
+    }
+
+    const long words = (totalRows + 63) / 64;
+    std::unique_ptr<std::atomic<uint64_t>[]> occupied(new std::atomic<uint64_t>[words * dimensions]);
+    for (long word = 0; word < words * dimensions; word++) {
+        occupied[word].store(0, std::memory_order_relaxed);
+    }
+    std::vector<double> ratio(dimensions);
+    for (int dimensionIndex = 0; dimensionIndex < dimensions; dimensionIndex++) {
+        ratio[dimensionIndex] = (scales[dimensionIndex][1] - scales[dimensionIndex][0]) / totalRows;
+    }
+
+    // second pass: mark every value's stratum
+    std::mutex reportMutex;
+    parallelFor(chunks.size(), [&](const long chunkIndex) {
+        const VerifyChunk& chunk = chunks[chunkIndex];
+        long outOfRange = 0, duplicates = 0, malformed = 0;
+        std::vector<Violation> violations;
+        auto record = [&](const long row, const int dimension, const double value, const std::string& problem) {
+            if (maxViolations == 0) {
+                return;
+            }
+            // queued marks are recorded late, so keep the earliest rather than the first recorded
+            violations.push_back({row, dimension, value, problem});
+            if (violations.size() >= 2 * maxViolations + VERIFY_PREFETCH_BATCH) {
+                std::sort(violations.begin(), violations.end(), violationBefore);
+                violations.resize(maxViolations);
+            }
+        };
+        // the bitset words are touched in random order, so marks are queued and their words
+        // prefetched a batch at a time, which overlaps the cache misses
+        struct Mark {
+            long row;
+            int dimension;
+            double value;
+            long stratum;
+        };
+        Mark queued[VERIFY_PREFETCH_BATCH];
+        int queuedCount = 0;
+        auto flush = [&]() {
+            for (int index = 0; index < queuedCount; index++) {
+                const Mark& queuedMark = queued[index];
+                const uint64_t bit = uint64_t(1) << (queuedMark.stratum % 64);
+                if (occupied[queuedMark.dimension * words + queuedMark.stratum / 64].fetch_or(bit, std::memory_order_relaxed) & bit) {
+                    duplicates++;
+                    record(queuedMark.row, queuedMark.dimension, queuedMark.value, "second point in stratum " + std::to_string(queuedMark.stratum));
+                }
+            }
+            queuedCount = 0;
+        };
+        auto mark = [&](const long row, const int dimension, const double value) {
+            const double position = (value - scales[dimension][0]) / ratio[dimension] + VERIFY_TOLERANCE;
+            if (!(position >= 0 && position < totalRows)) {
+                outOfRange++;
+                record(row, dimension, value, "outside the bounds");
+                return;
+            }
+            const long stratum = (long)position;
+            __builtin_prefetch(&occupied[dimension * words + stratum / 64], 1);
+            queued[queuedCount++] = {row, dimension, value, stratum};
+            if (queuedCount == VERIFY_PREFETCH_BATCH) {
+                flush();
+            }
+        };
+
+        long row = chunk.firstRow;
+        const char* data = chunk.file->data();
+        if (chunk.binary) {
+            for (size_t offset = chunk.begin; offset < chunk.end; offset += dimensions * sizeof(double), row++) {
+                for (int dimensionIndex = 0; dimensionIndex < dimensions; dimensionIndex++) {
+                    double value;
+                    std::memcpy(&value, data + offset + dimensionIndex * sizeof(double), sizeof(double));
+                    mark(row, dimensionIndex, value);
+                }
+            }
+        } else {
+            forEachLine(data + chunk.begin, data + chunk.end, [&](const char* cursor, const char* const lineEnd) {
+                int dimensionIndex = 0;
+                bool wellFormed = true;
+                while (wellFormed && cursor <= lineEnd && dimensionIndex < dimensions) {
+                    double value;
+                    auto [parsed, error] = std::from_chars(cursor, lineEnd, value);
+                    if (error != std::errc() || (parsed != lineEnd && *parsed != ',')) {
+                        wellFormed = false;
+                        break;
+                    }
+                    mark(row, dimensionIndex++, value);
+                    cursor = parsed + 1;
+                }
+                if (!wellFormed || dimensionIndex != dimensions || cursor <= lineEnd) {
+                    malformed++;
+                    record(row, -1, 0, "malformed row");
+                }
+                row++;
+            });
+        }
+
+        flush();
+
+        std::lock_guard<std::mutex> lock(reportMutex);
+        report.outOfRange += outOfRange;
+        report.duplicates += duplicates;
+        report.malformed += malformed;
+        report.first.insert(report.first.end(), violations.begin(), violations.end());
+    });
+
+    std::sort(report.first.begin(), report.first.end(), violationBefore);
+    if (report.first.size() > maxViolations) {
+        report.first.resize(maxViolations);
+    }
+
+    report.missing.assign(dimensions, 0);
+    parallelFor(dimensions, [&](const long dimensionIndex) {
+        long filled = 0;
+        for (long word = 0; word < words; word++) {
+            filled += __builtin_popcountll(occupied[dimensionIndex * words + word].load(std::memory_order_relaxed));
+        }
+        report.missing[dimensionIndex] = totalRows - filled;
+    });
+    return report;
+}
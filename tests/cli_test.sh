@@ -0,0 +1,43 @@
+#!/bin/sh
+#
+# Command-line checks that need a built binary.
+#
+# Every check runs lhc in a scratch directory and tests its exit status and
+# the files it leaves behind. The script prints one line per check and exits
+# with 1 if any failed.
+#
+# g++ -O2 -I include -o lhc src/main.cpp && sh tests/cli_test.sh ./lhc
+
+LHC=$(cd "$(dirname "${1:-./lhc}")" && pwd)/$(basename "${1:-./lhc}")
+SCRATCH=$(mktemp -d)
+trap 'rm -rf "$SCRATCH"' EXIT
+cd "$SCRATCH" || exit 1
+
+FAILED=0
+check() {
+    if [ "$2" = 0 ]; then
+        echo "ok      $1"
+    else
+        echo "FAILED  $1"
+        FAILED=1
+    fi
+}
+
+# augmenting a design must never truncate it, whatever the output path is called
+"$LHC" -n 100 -d 3 --seed 1 -o lhc.csv > /dev/null
+cp lhc.csv original.csv
+ln -s lhc.csv link.csv
+
+! "$LHC" --augment lhc.csv -n 50 > /dev/null 2>&1
+check "augment rejects the default output path when it is the input" $?
+! "$LHC" --augment lhc.csv -n 50 -o "$SCRATCH/lhc.csv" > /dev/null 2>&1
+check "augment rejects the input under another spelling" $?
+! "$LHC" --augment link.csv -n 50 -o lhc.csv > /dev/null 2>&1
+check "augment rejects the input through a symbolic link" $?
+cmp -s lhc.csv original.csv
+check "augment leaves a rejected input design intact" $?
+
+"$LHC" --augment lhc.csv -n 50 -o new.csv > /dev/null 2>&1 && [ "$(wc -l < new.csv)" -eq 50 ]
+check "augment writes the new points to another file" $?
+
+exit $FAILED
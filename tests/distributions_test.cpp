@@ -0,0 +1,196 @@
+/******************************************************************************
+
+Accuracy and throughput of the vector kernels in distributions.hpp.
+
+lanesLog and lanesExp are compared with std::log and std::exp, and
+lanesInverseNormal with a reference quantile refined by Newton's method on
+erfc in long double, over the ranges the marginals use. Truncated normal
+marginals, including intervals far in either tail, are compared with a long
+double bisection of their CDF. The program exits with 1 if any kernel is less
+accurate than its stated bound, and then prints the throughput of each kernel
+next to its scalar counterpart.
+
+g++ -O2 -I include -o distributions_test tests/distributions_test.cpp && ./distributions_test
+
+*******************************************************************************/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include "../src/distributions.hpp"
+
+// relative error bounds, in units of DBL_EPSILON
+constexpr double LOG_TOLERANCE = 4;
+constexpr double EXP_TOLERANCE = 4;
+constexpr double INVERSE_NORMAL_TOLERANCE = 16;
+constexpr double TRUNCATED_NORMAL_TOLERANCE = 64;
+
+constexpr long ACCURACY_SAMPLES = 1 << 20;
+constexpr long BENCHMARK_VALUES = 1 << 22;
+
+// The standard normal quantile to long double precision: Newton's method on
+// Phi(x) - p, started from the kernel's value.
+long double referenceInverseNormal(const double p, const double start) {
+    long double x = start;
+    for (int step = 0; step < 4; step++) {
+        const long double cdf = 0.5L * std::erfc(-x / std::sqrt(2.0L));
+        const long double density = std::exp(-0.5L * x * x) / std::sqrt(2.0L * 3.14159265358979323846L);
+        x -= (cdf - p) / density;
+    }
+    return x;
+}
+
+// The quantile of a standard normal truncated to [lower, upper] at u, by bisection of its CDF
+// in long double, taken in the tail that the interval lies in.
+long double referenceTruncatedNormal(const double lower, const double upper, const double u) {
+    const bool upperTail = lower + upper > 0;
+    auto tail = [&](const long double x) { return 0.5L * std::erfc((upperTail ? x : -x) / std::sqrt(2.0L)); };
+    auto share = [&](const long double x) { // of the mass between lower and x
+        return upperTail ? (tail(lower) - tail(x)) / (tail(lower) - tail(upper)) : (tail(x) - tail(lower)) / (tail(upper) - tail(lower));
+    };
+    long double low = lower, high = upper;
+    for (int step = 0; step < 100; step++) {
+        const long double middle = (low + high) / 2;
+        (share(middle) < u ? low : high) = middle;
+    }
+    return (low + high) / 2;
+}
+
+// The largest error of kernel against reference over the inputs, relative to
+// max(|reference|, floor), in units of DBL_EPSILON.
+template <class Kernel, class Reference>
+double maximumError(const std::vector<double>& inputs, const double floor, Kernel kernel, Reference reference, double& worstInput) {
+    double worst = 0;
+    for (size_t index = 0; index + LANES <= inputs.size(); index += LANES) {
+        DoubleLanes block;
+        std::memcpy(&block, inputs.data() + index, sizeof(block));
+        const DoubleLanes result = kernel(block);
+        for (int lane = 0; lane < LANES; lane++) {
+            const double input = inputs[index + lane];
+            const long double expected = reference(input, result[lane]);
+            const double error = std::fabs((long double)result[lane] - expected) / std::max<long double>(std::fabs(expected), floor) / std::numeric_limits<double>::epsilon();
+            if (error > worst) {
+                worst = error;
+                worstInput = input;
+            }
+        }
+    }
+    return worst;
+}
+
+bool check(const char* name, const double error, const double tolerance, const double input) {
+    const bool passed = error <= tolerance;
+    std::printf("%-20s max error %6.2f eps (bound %g) at %.17g: %s\n", name, error, tolerance, input, passed ? "ok" : "FAILED");
+    return passed;
+}
+
+// Inputs spread log-uniformly over [lower, upper], plus the end points.
+std::vector<double> logUniform(std::mt19937_64& generator, const double lower, const double upper) {
+    std::uniform_real_distribution<double> exponent(std::log(lower), std::log(upper));
+    std::vector<double> inputs{lower, upper};
+    while ((long)inputs.size() < ACCURACY_SAMPLES) {
+        inputs.push_back(std::exp(exponent(generator)));
+    }
+    return inputs;
+}
+
+// BENCHMARK_VALUES inputs, cycling through the given ones.
+std::vector<double> repeated(const std::vector<double>& inputs) {
+    std::vector<double> values(BENCHMARK_VALUES);
+    for (long index = 0; index < BENCHMARK_VALUES; index++) {
+        values[index] = inputs[index % inputs.size()];
+    }
+    return values;
+}
+
+template <class Kernel>
+double valuesPerSecond(std::vector<double> values, Kernel kernel) {
+    const auto start = std::chrono::steady_clock::now();
+    kernel(values.data(), (long)values.size());
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    volatile double sink = values[values.size() / 2];
+    (void)sink;
+    return values.size() / seconds;
+}
+
+void benchmark(const char* name, const std::vector<double>& inputs, void (*lanes)(double*, long), void (*scalar)(double*, long)) {
+    const double lanesRate = valuesPerSecond(inputs, lanes);
+    const double scalarRate = valuesPerSecond(inputs, scalar);
+    std::printf("%-20s %8.1f M values/s, scalar %8.1f M values/s, %.2fx\n", name, lanesRate / 1e6, scalarRate / 1e6, lanesRate / scalarRate);
+}
+
+int main() {
+    std::mt19937_64 generator(1);
+    bool passed = true;
+    double input = 0;
+
+    const std::vector<double> logInputs = logUniform(generator, 1e-300, 1e300);
+    double error = maximumError(logInputs, 1, lanesLog, [](const double x, double) { return std::log((long double)x); }, input);
+    passed = check("lanesLog", error, LOG_TOLERANCE, input) && passed;
+
+    std::vector<double> expInputs;
+    std::uniform_real_distribution<double> exponent(-708, 709);
+    while ((long)expInputs.size() < ACCURACY_SAMPLES) {
+        expInputs.push_back(exponent(generator));
+    }
+    error = maximumError(expInputs, 0, lanesExp, [](const double x, double) { return std::exp((long double)x); }, input);
+    passed = check("lanesExp", error, EXP_TOLERANCE, input) && passed;
+
+    // probabilities near 0 and 1 as well as in the centre, as the strata of a large design
+    std::vector<double> probabilities = logUniform(generator, 1e-300, 0.5);
+    for (long index = 0; index < ACCURACY_SAMPLES; index += 2) {
+        probabilities[index] = 1.0 - probabilities[index];
+    }
+    error = maximumError(probabilities, 1, lanesInverseNormal, referenceInverseNormal, input);
+    passed = check("lanesInverseNormal", error, INVERSE_NORMAL_TOLERANCE, input) && passed;
+
+    // the strata centres of a design of 1000 points; every value must be distinct and increasing
+    for (const std::vector<std::string>& bounds : std::vector<std::vector<std::string>>{{"10", "20"}, {"-20", "-10"}, {"6", "7"}, {"-7", "-6"}, {"-1", "2"}, {"0.5", "3"}}) {
+        const Marginal marginal = makeMarginal("truncnormal", {"0", "1", bounds[0], bounds[1]});
+        std::vector<double> values(1000);
+        for (size_t index = 0; index < values.size(); index++) {
+            values[index] = (index + 0.5) / values.size();
+        }
+        applyMarginal(marginal, values.data(), values.size());
+        double worst = 0;
+        bool increasing = true;
+        for (size_t index = 0; index < values.size(); index++) {
+            const long double expected = referenceTruncatedNormal(std::stod(bounds[0]), std::stod(bounds[1]), (index + 0.5) / values.size());
+            const double error = std::fabs(values[index] - expected) / std::max<long double>(std::fabs(expected), 1) / std::numeric_limits<double>::epsilon();
+            if (error > worst) {
+                worst = error;
+                input = (index + 0.5) / values.size();
+            }
+            increasing = increasing && (index == 0 || values[index] > values[index - 1]);
+        }
+        const std::string name = "truncnormal:0:1:" + bounds[0] + ":" + bounds[1];
+        passed = check(name.c_str(), worst, TRUNCATED_NORMAL_TOLERANCE, input) && passed;
+        if (!increasing) {
+            std::printf("%-20s values are not strictly increasing: FAILED\n", name.c_str());
+            passed = false;
+        }
+    }
+
+    benchmark("log", repeated(logInputs),
+        [](double* values, long count) { applyLanes(values, count, lanesLog); },
+        [](double* values, long count) { for (long index = 0; index < count; index++) values[index] = std::log(values[index]); });
+
+    benchmark("exp", repeated(expInputs),
+        [](double* values, long count) { applyLanes(values, count, [](DoubleLanes x) { return lanesExp(x); }); },
+        [](double* values, long count) { for (long index = 0; index < count; index++) values[index] = std::exp(values[index]); });
+
+    std::vector<double> uniforms(BENCHMARK_VALUES);
+    std::uniform_real_distribution<double> unit(0, 1);
+    for (double& value : uniforms) {
+        value = unit(generator);
+    }
+    // the scalar counterpart is one AS 241 evaluation per value, in a lane of its own
+    benchmark("inverse normal", uniforms,
+        [](double* values, long count) { applyLanes(values, count, lanesInverseNormal); },
+        [](double* values, long count) { for (long index = 0; index < count; index++) values[index] = lanesInverseNormal(splat(values[index]))[0]; });
+
+    return passed ? 0 : 1;
+}
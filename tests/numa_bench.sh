@@ -0,0 +1,35 @@
+#!/bin/sh
+#
+# Times a design under each --numa policy.
+#
+# Runs the same plain random design with --numa off, interleave and
+# first-touch, several times each, and prints the best time and rate of every
+# policy. The design is written to /dev/null, so the times are those of the
+# strata and the formatting, which is where placement matters. On a machine
+# with a single memory node the three policies should time within noise.
+#
+# g++ -O2 -I include -o lhc src/main.cpp && sh tests/numa_bench.sh ./lhc [rows] [dimensions] [runs]
+
+set -e
+
+LHC=${1:-./lhc}
+ROWS=${2:-8000000}
+DIMENSIONS=${3:-4}
+RUNS=${4:-3}
+
+NODES=$(ls -d /sys/devices/system/node/node[0-9]* 2>/dev/null | wc -l)
+echo "$ROWS rows x $DIMENSIONS dimensions, best of $RUNS, $NODES NUMA node(s), $(nproc) core(s)"
+
+for POLICY in off interleave first-touch; do
+    BEST=
+    RUN=0
+    while [ "$RUN" -lt "$RUNS" ]; do
+        START=$(date +%s.%N)
+        "$LHC" -n "$ROWS" -d "$DIMENSIONS" --seed 1 --numa "$POLICY" -o /dev/null > /dev/null
+        END=$(date +%s.%N)
+        BEST=$(awk -v start="$START" -v end="$END" -v best="$BEST" 'BEGIN { time = end - start; if (best == "" || time < best) best = time; print best }')
+        RUN=$((RUN + 1))
+    done
+    awk -v policy="$POLICY" -v time="$BEST" -v values=$((ROWS * DIMENSIONS)) \
+        'BEGIN { printf "%-12s %7.3f s  %7.1f M values/s\n", policy, time, values / time / 1e6 }'
+done